@@ -0,0 +1,84 @@
+/*
+ * This file is part of the kyuba.org Dev9 project.
+ * See the appropriate repository at http://git.kyuba.org/ for exact file
+ * modification records.
+*/
+
+/*
+ * Copyright (c) 2008-2014, Kyuba Project Members
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#ifndef DEV9_AUTOLOAD_H
+#define DEV9_AUTOLOAD_H
+
+#include <curie/sexpr.h>
+#include <duat/filesystem.h>
+
+/* Placeholder nodes for devices whose drivers may not be loaded yet, e.g.
+ *   (placeholder "loop-control" 10 237 "loop")
+ * creates loop-control as c 10:237 right away, and the loader helper set with
+ *   (loader "/sbin/modprobe" "-q")
+ * is run with "loop" appended when the module is requested, either through
+ * the control file or by walking to the placeholder. Such a walk is held
+ * back until the device is added or the load fails, so an open of the
+ * placeholder opens the real device. Placeholders that name the same module
+ * share its state, so only one loader is started for all of them. The
+ * owner, group and mode come from the rules, which see the event the device
+ * would be added with; its SUBSYSTEM is "misc" unless a fifth argument says
+ * otherwise. */
+
+#define DEV9_DEFAULT_LOADER "/sbin/modprobe"
+#define DEV9_DEFAULT_SUBSYSTEM "misc"
+
+/* seconds walks wait for a placeholder's device before they fail with
+ * ENODEV; a loader that is still running by then is killed */
+#define DEV9_AUTOLOAD_TIMEOUT 10
+
+void dev9_autoload_add (sexpr);
+void dev9_autoload_set_loader (sexpr);
+
+/* creates all placeholder nodes that don't exist right now */
+void dev9_autoload_initialise (struct dfs *);
+
+/* brings back the placeholders for a device that was removed, so that its
+ * module can be loaded again */
+void dev9_autoload_restore (struct dfs *, int_16, int_16);
+
+/* tells the placeholders with these numbers that their device was added */
+void dev9_autoload_arrived (int_16, int_16);
+
+/* called for walks that end on a device node; returns 1 if the node has
+ * the numbers of a placeholder whose driver is being loaded, and the walk
+ * has to wait */
+char dev9_autoload_walk (struct dfs_node_common *);
+
+/* runs the loader for a placeholder's module unless it's already running or
+ * has succeeded before; accepts both node paths and module names */
+void dev9_autoload_request (const char *);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,58 @@
+/*
+ * This file is part of the kyuba.org Dev9 project.
+ * See the appropriate repository at http://git.kyuba.org/ for exact file
+ * modification records.
+*/
+
+/*
+ * Copyright (c) 2008-2014, Kyuba Project Members
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#ifndef DEV9_BATCH_H
+#define DEV9_BATCH_H
+
+#include <curie/sexpr.h>
+#include <duat/filesystem.h>
+
+/* Events are queued per ingestion batch and folded per DEVPATH into their
+ * net effect before the rules see them: add+change becomes a single add with
+ * the latest attributes, add+remove cancels out if the device wasn't known
+ * before the batch and becomes the remove otherwise, change+change and
+ * change+remove keep only the latter, in the place of the first. Everything
+ * else is applied as-is. A batch is everything the netlink socket has
+ * queued up before a read would block. An event whose rules match on sysfs
+ * attributes stays queued, along with everything after it, until the probe
+ * workers have read them. */
+
+void dev9_batch_add (sexpr);
+void dev9_batch_flush (struct dfs *);
+
+/* flushes again once attributes have come in */
+void dev9_batch_resume (void);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
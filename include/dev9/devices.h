@@ -0,0 +1,159 @@
+/*
+ * This file is part of the kyuba.org Dev9 project.
+ * See the appropriate repository at http://git.kyuba.org/ for exact file
+ * modification records.
+*/
+
+/*
+ * Copyright (c) 2008-2014, Kyuba Project Members
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#ifndef DEV9_DEVICES_H
+#define DEV9_DEVICES_H
+
+#include <curie/sexpr.h>
+#include <duat/filesystem.h>
+#include <dev9/index.h>
+
+#define DEV9_PATH_DEPTH 32
+
+/* One record per device, keyed by DEVPATH. The record owns every node name
+ * that the rules created for the device, so aliases are released together
+ * with the device, and alias directories go away once they're empty. The
+ * aliases themselves are further directory entries for the device's first
+ * node, as with snd/, .all/ or a short name like dsp. Names added by the
+ * identity probe are kept apart from the rules' names, so that running the
+ * rules again doesn't take them away. Nodes and directories nothing refers
+ * to anymore are handed out again for new ones. */
+
+struct dev9_device
+{
+    const char *devpath;
+    const char *subsystem;
+    const char *user;
+    const char *group;
+    int_32 mode;
+    int_16 majour;
+    int_16 minor;
+    char block_device;
+
+    /* NUL-separated node paths, relative to the root; the ones the rules
+     * made, and the ones the identity probe added */
+    char *names;
+    int_32 names_length;
+    char *probed;
+    int_32 probed_length;
+};
+
+struct dev9_device *dev9_device_find (const char *);
+struct dev9_device *dev9_device_get (const char *);
+
+/* replace the device's names; returns the paths that were released */
+sexpr dev9_device_set_names (struct dev9_device *, struct dfs *, sexpr);
+
+/* unlink all of the device's nodes and forget the device; returns the paths
+ * that were released */
+sexpr dev9_device_drop (struct dev9_device *, struct dfs *);
+
+/* create an entry in a directory and add it to the directory's listing;
+ * directories created this way are released by dev9_device_unlink once the
+ * last entry is gone */
+struct dfs_device *dev9_mk_device
+        (struct dfs_directory *, const char *, char, int_16, int_16);
+struct dfs_directory *dev9_mk_directory (struct dfs_directory *, const char *);
+
+/* put a device node in a directory, reusing a node with the same numbers if
+ * there is one. Otherwise, if a node is given, the entry refers to that
+ * node, so a device's aliases cost a listing entry each rather than a
+ * dfs_device of their own. Returns (struct dfs_device *)0 if the name is
+ * taken by something that isn't a device node. */
+struct dfs_device *dev9_mk_alias
+        (struct dfs_directory *, const char *, struct dfs_device *, char,
+         int_16, int_16);
+
+char dev9_device_unlink (struct dfs *, const char *, int_16, int_16);
+
+/* create a node along with any missing directories; existing nodes are left
+ * alone and (struct dfs_device *)0 is returned for them */
+struct dfs_device *dev9_device_mknod
+        (struct dfs *, const char *, char, int_16, int_16);
+
+/* create a node like dev9_device_mknod, but return an existing device node
+ * at the path so it can be brought up to date, the way the rules' mknod
+ * does; a node with different numbers is replaced */
+struct dfs_device *dev9_device_mknod_update
+        (struct dfs *, const char *, char, int_16, int_16);
+
+/* replace the names the identity probe added for the device, creating the
+ * nodes that are missing; the rules' names are left alone. Returns the paths
+ * that were released */
+sexpr dev9_device_set_probed_names
+        (struct dev9_device *, struct dfs *, sexpr);
+
+/* walk all of a device's names, start with the cursor at 0; returns
+ * (const char *)0 after the last one */
+const char *dev9_device_next_name (struct dev9_device *, int_32 *);
+
+/* the listing of a directory that device nodes were put in, by name, or
+ * (struct dev9_index *)0 for directories that are left to duat */
+struct dev9_index *dev9_directory_listing (struct dfs_directory *);
+
+/* look up an entry by name, whether or not it's in duat's tree */
+struct dfs_node_common *dev9_directory_lookup
+        (struct dfs_directory *, const char *);
+
+/* the entries dev9 adds are only in the directory's listing, until a 9p
+ * walk needs to go through them; this puts one into duat's tree for the
+ * duration of a walk. Returns the name to pass to
+ * dev9_directory_dematerialise once the walk is done, or (const char *)0
+ * if there's nothing to take out again. */
+const char *dev9_directory_materialise
+        (struct dfs_directory *, const char *);
+void dev9_directory_dematerialise (struct dfs_directory *, const char *);
+
+/* keep a node from being handed out again while a 9p client refers to it */
+void dev9_node_hold (struct dfs_node_common *);
+void dev9_node_release (struct dfs_node_common *);
+
+/* what the device nodes cost, as also shown in dev9/statistics */
+struct dev9_device_usage
+{
+    int_64 devices;
+    int_64 nodes;
+    int_64 directories;
+    int_64 entries;
+    int_64 materialised;
+    int_64 spare;
+};
+
+void dev9_device_usage (struct dev9_device_usage *);
+
+/* all known devices, in the order they were added */
+struct dev9_index *dev9_device_table (void);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,53 @@
+/*
+ * This file is part of the kyuba.org Dev9 project.
+ * See the appropriate repository at http://git.kyuba.org/ for exact file
+ * modification records.
+*/
+
+/*
+ * Copyright (c) 2008-2014, Kyuba Project Members
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef DEV9_EVENTS_H
+#define DEV9_EVENTS_H
+
+#include <curie/sexpr.h>
+#include <duat/filesystem.h>
+
+/* size of the shared event ring, in bytes and in records */
+#define DEV9_EVENTS_BUFFER  (1024*64)
+#define DEV9_EVENTS_RECORDS 1024
+
+struct dfs_file *dev9_events_initialise (struct dfs_directory *);
+
+/* record an event: its uevent attributes and the nodes that were touched;
+ * events that didn't touch any nodes are not recorded */
+void dev9_events_record (sexpr, sexpr);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
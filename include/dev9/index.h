@@ -0,0 +1,122 @@
+/*
+ * This file is part of the kyuba.org Dev9 project.
+ * See the appropriate repository at http://git.kyuba.org/ for exact file
+ * modification records.
+*/
+
+/*
+ * Copyright (c) 2008-2014, Kyuba Project Members
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef DEV9_INDEX_H
+#define DEV9_INDEX_H
+
+#include <curie/tree.h>
+
+/* Dense index: entries are kept in insertion order in a packed array, so
+ * listings are linear in size and a reader can resume at a byte offset
+ * without re-walking the listing. The entries only point at their nodes;
+ * whatever a listing shows is rendered from the node. Entries are looked up
+ * by their node, or by their name in indices of named entries such as the
+ * listings of directories. */
+
+#define DEV9_INDEX_CURSORS 8
+
+struct dev9_index_entry
+{
+    const char *name;
+    void *node;
+};
+
+struct dev9_index
+{
+    struct dev9_index_entry *entries;
+    int_32 used;
+    int_32 allocated;
+    int_32 live;
+
+    int_32 generation;
+    struct tree nodes;
+};
+
+/* where a read stopped: the entry to continue with, how much of it has
+ * been read already, and that entry's key in case the index has been
+ * compacted since */
+struct dev9_index_cursor
+{
+    int_64 offset;
+    int_32 entry;
+    int_32 skip;
+    int_32 generation;
+    const char *next_name;
+    void *next;
+};
+
+/* the cursors of one listing; every file that serves a listing of an index
+ * keeps its own, so its readers don't push out the cursors of others */
+struct dev9_index_reader
+{
+    struct dev9_index_cursor cursor[DEV9_INDEX_CURSORS];
+    unsigned int next_cursor;
+};
+
+/* renders one entry into the buffer; returns the size of the entry, or 0 to
+ * skip it. An entry that is bigger than the buffer isn't written, so a
+ * buffer of length 0 measures it. */
+typedef int_32 (*dev9_index_render)
+        (struct dev9_index_entry *, void *, int_32, int_8 *);
+
+struct dev9_index *dev9_index_create (void);
+void dev9_index_destroy (struct dev9_index *);
+
+void dev9_index_add (struct dev9_index *, void *);
+void dev9_index_remove (struct dev9_index *, void *);
+char dev9_index_contains (struct dev9_index *, void *);
+
+/* named entries; the name must be an immutable string, and it's unique
+ * within the index */
+void dev9_index_add_named (struct dev9_index *, const char *, void *);
+void dev9_index_remove_named (struct dev9_index *, const char *);
+void *dev9_index_lookup (struct dev9_index *, const char *);
+
+void dev9_index_reader_initialise (struct dev9_index_reader *);
+
+/* reads whole entries, as many as fit; returns -1 if not even the next one
+ * does, rather than pretending the listing ended */
+int_32 dev9_index_read
+        (struct dev9_index *, struct dev9_index_reader *, int_64, int_32,
+         int_8 *, dev9_index_render, void *);
+
+/* reads the listing as a stream of bytes: an entry that doesn't fit is cut
+ * off where the read ends, and the next read continues with the rest */
+int_32 dev9_index_read_partial
+        (struct dev9_index *, struct dev9_index_reader *, int_64, int_32,
+         int_8 *, dev9_index_render, void *);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,77 @@
+/*
+ * This file is part of the kyuba.org Dev9 project.
+ * See the appropriate repository at http://git.kyuba.org/ for exact file
+ * modification records.
+*/
+
+/*
+ * Copyright (c) 2008-2014, Kyuba Project Members
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#ifndef DEV9_PROBE_H
+#define DEV9_PROBE_H
+
+#include <curie/sexpr.h>
+#include <duat/filesystem.h>
+#include <dev9/devices.h>
+#include <dev9/signatures.h>
+
+/* Block device identities for disk/by-uuid, disk/by-label, disk/by-id and
+ * disk/by-partuuid. Probing reads filesystem and partition table signatures
+ * off the device, so it's done by a small pool of worker processes; the
+ * results come back over pipes, are cached per device until the next change
+ * or remove event, and are then published as extra nodes for the device.
+ * Enabled with (identity-probe "/dev" 2): the directory to open the device
+ * nodes in, and the number of workers. The same workers read the sysfs
+ * attributes that rules match on; if there are such rules but no identity
+ * probes, a single worker is started just for those. */
+
+#define DEV9_PROBE_WORKERS_MAX 8
+
+void dev9_probe_configure (sexpr);
+
+/* fork the workers; must happen after dev9 has detached, so the workers are
+ * its children, and before anything else is multiplexed */
+void dev9_probe_initialise (void);
+
+/* request or reuse the identity of a block device; the DEVNAME is the node to
+ * open below the configured directory */
+void dev9_probe_device
+        (struct dev9_device *, const char *, char, struct dfs *);
+
+void dev9_probe_forget (const char *);
+
+/* probes the devices whose nodes couldn't be opened before, e.g. because
+ * the directory they're opened in wasn't mounted yet */
+void dev9_probe_retry (void);
+
+/* hands a sysfs attribute read to the least busy worker, tagged with the
+ * given generation; returns 0 if there are no workers */
+char dev9_probe_attribute (const char *, const char *, int_32);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,52 @@
+/*
+ * This file is part of the kyuba.org Dev9 project.
+ * See the appropriate repository at http://git.kyuba.org/ for exact file
+ * modification records.
+*/
+
+/*
+ * Copyright (c) 2008-2014, Kyuba Project Members
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#ifndef DEV9_QUERY_H
+#define DEV9_QUERY_H
+
+#include <curie/sexpr.h>
+#include <duat/filesystem.h>
+
+/* dev9/devices lists the whole device table, one S-expression per device,
+ * rendered straight from the table as it's read. Filtered listings are set
+ * up through the control file, e.g.
+ *   (query "disks" (subsystem . "block") (devpath . "/devices/pci"))
+ *   (query "sound" (path . "snd/"))
+ * and then show up as dev9/query/disks and dev9/query/sound. */
+
+void dev9_query_initialise (struct dfs_directory *);
+void dev9_query_add (sexpr);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -43,11 +43,42 @@ enum dev9_opcodes {
     dev9op_set_group,
     dev9op_set_user,
     dev9op_set_attribute_block_device,
-    dev9op_set_mode
+    dev9op_set_mode,
+    dev9op_cond,
+    dev9op_last
 };
 
+#define DEV9_PATH_MAX 1024
+
+sexpr dev9_lookup_symbol (sexpr, sexpr);
+
+char dev9_streq (const char *, const char *);
+
+/* append to a NUL-terminated string in a buffer of the given size; returns
+ * the new length, or -1 if it didn't fit. -1 is passed on by further calls,
+ * so a sequence of appends only needs to be checked at the end. */
+int_32 dev9_append_string (char *, int_32, int_32, const char *);
+int_32 dev9_append_integer (char *, int_32, int_32, int_32);
+
 void dev9_rules_add (sexpr, struct sexpr_io *);
-void dev9_rules_apply (sexpr, struct dfs *);
+
+/* returns the list of node paths created, updated or removed by the event */
+sexpr dev9_rules_apply (sexpr, struct dfs *);
+
+struct dev9_device;
+
+/* runs the rules over an event without creating or removing any nodes, and
+ * fills in the owner, group, mode, type and numbers they would give it */
+void dev9_rules_describe (sexpr, struct dev9_device *);
+
+/* runs the rules over an event like dev9_rules_describe, but only to have
+ * the probe workers read the sysfs attributes the rules would look at;
+ * returns 1 once all of them are cached and the event can be applied
+ * without blocking */
+char dev9_rules_ready (sexpr);
+
+/* whether any rule matches on sysfs attributes */
+char dev9_rules_read_attributes (void);
 
 #endif
 
@@ -0,0 +1,73 @@
+/*
+ * This file is part of the kyuba.org Dev9 project.
+ * See the appropriate repository at http://git.kyuba.org/ for exact file
+ * modification records.
+*/
+
+/*
+ * Copyright (c) 2008-2014, Kyuba Project Members
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#ifndef DEV9_SIGNATURES_H
+#define DEV9_SIGNATURES_H
+
+/* Filesystem and partition table signatures. Everything here works on plain
+ * file descriptors, so the same code reads devices in the probe workers and
+ * image files in dev9-identify. */
+
+#define DEV9_PROBE_UUID  37
+#define DEV9_PROBE_LABEL 65
+#define DEV9_PROBE_ID    129
+
+struct dev9_identity
+{
+    char uuid[DEV9_PROBE_UUID];
+    char label[DEV9_PROBE_LABEL];
+    char id[DEV9_PROBE_ID];
+
+    /* PTUUID of a disk with a partition table, and PARTUUID of a partition,
+     * MBR ones formatted as the kernel's root=PARTUUID= does */
+    char ptuuid[DEV9_PROBE_UUID];
+    char partuuid[DEV9_PROBE_UUID];
+};
+
+void dev9_identity_clear (struct dev9_identity *);
+
+/* read the signatures off an open device or image file; bounded to a few
+ * small reads near the start of the device */
+void dev9_probe_identify (int, struct dev9_identity *);
+
+/* read the partition table off an open disk or image file and fill in the
+ * PARTUUID of its partition with the given number, counting from 1 */
+void dev9_probe_partition (int, int, struct dev9_identity *);
+
+/* copy a name that'll become a path component: no slashes, no blanks or
+ * control characters, and no trailing padding */
+void dev9_probe_name (char *, int, const unsigned char *, int);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,76 @@
+/*
+ * This file is part of the kyuba.org Dev9 project.
+ * See the appropriate repository at http://git.kyuba.org/ for exact file
+ * modification records.
+*/
+
+/*
+ * Copyright (c) 2008-2014, Kyuba Project Members
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#ifndef DEV9_SYSFS_H
+#define DEV9_SYSFS_H
+
+#include <curie/sexpr.h>
+
+#define DEV9_SYSFS_ATTRIBUTE_MAX 4096
+
+/* Reads a sysfs attribute below a DEVPATH, e.g. "removable" or
+ * "queue/rotational", with trailing newlines stripped. Values are cached per
+ * device until the cache is invalidated, so each attribute is read at most
+ * once per event. Returns sx_nonexistent if the attribute can't be read.
+ * Reads that aren't cached yet happen right here and block until the driver
+ * answers, so events get their attributes prefetched first. */
+sexpr dev9_sysfs_attribute (const char *, const char *);
+
+/* returns 1 if the attribute is cached; otherwise hands the read to a probe
+ * worker and returns 0, and the value comes in through dev9_sysfs_store.
+ * Without any workers, the attribute is read right away. */
+char dev9_sysfs_prefetch (const char *, const char *);
+
+/* a worker's answer: DEVPATH, name, the request's generation and the value
+ * or anything but a string if it couldn't be read; returns 1 unless the
+ * answer is stale */
+char dev9_sysfs_store (const char *, const char *, int_32, sexpr);
+
+/* reads an attribute without looking at or filling the cache, for DEVPATHs
+ * that are only guesses */
+sexpr dev9_sysfs_attribute_uncached (const char *, const char *);
+
+/* the read itself: fills a buffer of DEV9_SYSFS_ATTRIBUTE_MAX bytes and
+ * returns the length, or -1 */
+int_32 dev9_sysfs_read (const char *, const char *, char *);
+
+/* to be called when an event for the DEVPATH comes in */
+void dev9_sysfs_invalidate (const char *);
+
+/* forgets all reads that are still with the workers, e.g. because one of
+ * them died; they're asked for again on the next prefetch */
+void dev9_sysfs_abandon (void);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,59 @@
+/*
+ * This file is part of the kyuba.org Dev9 project.
+ * See the appropriate repository at http://git.kyuba.org/ for exact file
+ * modification records.
+*/
+
+/*
+ * Copyright (c) 2008-2014, Kyuba Project Members
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#ifndef DEV9_TRANSPORT_H
+#define DEV9_TRANSPORT_H
+
+#include <curie/io.h>
+#include <duat/filesystem.h>
+
+/* Every 9p connection is relayed to duat through a pair of pipes, so dev9
+ * can follow the fids of its clients. Reads of directories whose listing
+ * dev9 keeps itself are answered right here, from that listing: the
+ * entries are packed up to the read's count and a read at the offset where
+ * the last one stopped resumes in constant time. Everything else goes to
+ * duat unchanged. */
+
+void dev9_transport_add_io (struct io *, struct io *, struct dfs *);
+void dev9_transport_add_stdio (struct dfs *);
+void dev9_transport_add_socket (const char *, struct dfs *);
+
+/* walks that end on a placeholder whose driver is being loaded are held
+ * back, in /dev and in the views; this sends those that end on a node with
+ * the given numbers on to duat, or fails them with ENODEV if the device
+ * didn't turn up */
+void dev9_transport_release (int_16, int_16, char);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,90 @@
+/*
+ * This file is part of the kyuba.org Dev9 project.
+ * See the appropriate repository at http://git.kyuba.org/ for exact file
+ * modification records.
+*/
+
+/*
+ * Copyright (c) 2008-2014, Kyuba Project Members
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef DEV9_VIEWS_H
+#define DEV9_VIEWS_H
+
+#include <curie/sexpr.h>
+#include <duat/filesystem.h>
+#include <dev9/devices.h>
+
+/* Named views: filtered and optionally renamed copies of the device nodes,
+ * each in its own small dfs that's served on its own socket or mounted
+ * somewhere, e.g. for a container:
+ *   (view "c1" (socket "/run/dev9/c1") (mount "/srv/c1/dev")
+ *              (subsystem "mem|tty|misc")
+ *              (select "null|zero|random|urandom|tty|ptmx|net/tun")
+ *              (rename "net/" "network/"))
+ * Views are fed from the device records after the rules ran, so the rules
+ * are evaluated once per event no matter how many views there are; a view
+ * only holds the nodes it selected. */
+
+#define DEV9_VIEW_PATTERNS 8
+
+struct dev9_view
+{
+    const char *name;
+    const char *socket;
+    const char *mountpoint;
+    struct dfs *fs;
+
+    sexpr subsystems[DEV9_VIEW_PATTERNS];
+    unsigned int subsystems_count;
+    sexpr selections[DEV9_VIEW_PATTERNS];
+    unsigned int selections_count;
+    const char *rename_from[DEV9_VIEW_PATTERNS];
+    const char *rename_to[DEV9_VIEW_PATTERNS];
+    unsigned int renames_count;
+
+    struct dev9_view *next;
+};
+
+void dev9_view_add (sexpr);
+void dev9_views_initialise (void);
+struct dev9_view *dev9_views (void);
+
+/* bring the views up to date for the given node paths of a device, which
+ * have just been created, updated or released */
+void dev9_views_update (struct dev9_device *, sexpr);
+
+/* nodes that aren't in any device record, like placeholders; the device is
+ * only a description */
+void dev9_views_add (struct dev9_device *, sexpr);
+
+/* the device is gone, along with the given node paths */
+void dev9_views_remove (struct dev9_device *, sexpr);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
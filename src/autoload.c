@@ -0,0 +1,463 @@
+/*
+ * This file is part of the kyuba.org Dev9 project.
+ * See the appropriate repository at http://git.kyuba.org/ for exact file
+ * modification records.
+*/
+
+/*
+ * Copyright (c) 2008-2014, Kyuba Project Members
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+
+#include <dev9/autoload.h>
+#include <dev9/devices.h>
+#include <dev9/rules.h>
+#include <dev9/statistics.h>
+#include <dev9/transport.h>
+#include <dev9/views.h>
+#include <curie/main.h>
+#include <curie/memory.h>
+#include <curie/multiplex.h>
+#include <curie/exec.h>
+#include <sievert/immutable.h>
+#include <syscall/syscall.h>
+
+#include <linux/time.h>
+
+#define LOADER_ARGUMENTS 16
+
+define_symbol (sym_action,    "ACTION");
+define_symbol (sym_devpath,   "DEVPATH");
+define_symbol (sym_devname,   "DEVNAME");
+define_symbol (sym_subsystem, "SUBSYSTEM");
+define_symbol (sym_majour,    "MAJOR");
+define_symbol (sym_minor,     "MINOR");
+
+enum module_state
+{
+    ms_idle,
+    ms_loading,
+    ms_loaded
+};
+
+/* placeholders that share a module share one of these, so that e.g.
+ * loop-control and loop0 only ever start one loader between them */
+static struct module
+{
+    const char *name;
+    enum module_state state;
+    struct exec_context *context;
+    struct exec_context *timer;
+
+    struct module *next;
+} *modules = (struct module *)0;
+
+static struct placeholder
+{
+    const char *path;
+    const char *subsystem;
+    int_16 majour;
+    int_16 minor;
+    struct module *module;
+
+    /* whether the real device with the same numbers has been added since
+     * the placeholder was created */
+    char present;
+
+    struct placeholder *next;
+} *placeholders = (struct placeholder *)0;
+
+static const char *loader[LOADER_ARGUMENTS] = { DEV9_DEFAULT_LOADER };
+static unsigned int loader_arguments = 1;
+
+static int_64 loads_started   = 0;
+static int_64 loads_succeeded = 0;
+static int_64 loads_timed_out = 0;
+
+static struct module *get_module (const char *name)
+{
+    static struct memory_pool pool
+            = MEMORY_POOL_INITIALISER (sizeof (struct module));
+    struct module *m;
+
+    for (m = modules; m != (struct module *)0; m = m->next)
+    {
+        if (dev9_streq (m->name, name)) return m;
+    }
+
+    m = (struct module *)get_pool_mem (&pool);
+
+    m->name    = name;
+    m->state   = ms_idle;
+    m->context = (struct exec_context *)0;
+    m->timer   = (struct exec_context *)0;
+    m->next    = modules;
+
+    modules = m;
+
+    return m;
+}
+
+void dev9_autoload_add (sexpr sx)
+{
+    static struct memory_pool pool
+            = MEMORY_POOL_INITIALISER (sizeof (struct placeholder));
+    sexpr path      = car (sx);
+    sexpr majour    = car (cdr (sx));
+    sexpr minor     = car (cdr (cdr (sx)));
+    sexpr module    = car (cdr (cdr (cdr (sx))));
+    sexpr subsystem = car (cdr (cdr (cdr (cdr (sx)))));
+    struct placeholder *p;
+
+    if (!stringp(path) || !integerp(majour) || !integerp(minor) ||
+        !stringp(module))
+    {
+        return;
+    }
+
+    p = (struct placeholder *)get_pool_mem (&pool);
+
+    p->path      = str_immutable (sx_string (path));
+    p->subsystem = stringp(subsystem)
+                 ? str_immutable (sx_string (subsystem))
+                 : DEV9_DEFAULT_SUBSYSTEM;
+    p->majour    = (int_16)sx_integer (majour);
+    p->minor     = (int_16)sx_integer (minor);
+    p->module    = get_module (str_immutable (sx_string (module)));
+    p->present   = 0;
+    p->next      = placeholders;
+
+    placeholders = p;
+}
+
+void dev9_autoload_set_loader (sexpr sx)
+{
+    loader_arguments = 0;
+
+    for (; consp(sx) && (loader_arguments < (LOADER_ARGUMENTS - 2));
+         sx = cdr (sx))
+    {
+        sexpr a = car (sx);
+
+        if (stringp(a))
+        {
+            loader[loader_arguments] = str_immutable (sx_string (a));
+            loader_arguments++;
+        }
+    }
+
+    if (loader_arguments == 0)
+    {
+        loader[0] = DEV9_DEFAULT_LOADER;
+        loader_arguments = 1;
+    }
+}
+
+/* MAJOR and MINOR are strings in uevents */
+static sexpr number_string (int_32 n)
+{
+    char buffer[16];
+    int_32 l = dev9_append_integer (buffer, 0, sizeof (buffer), n);
+
+    buffer[(l < 0) ? 0 : l] = (char)0;
+
+    return make_string (buffer);
+}
+
+/* the event the kernel would send for the device once its driver is loaded,
+ * as far as we can guess it */
+static sexpr placeholder_event (struct placeholder *p)
+{
+    char devpath[DEV9_PATH_MAX];
+    const char *base = p->path;
+    int_32 l = 0;
+
+    for (const char *c = p->path; (*c) != (char)0; c++)
+    {
+        if ((*c) == '/') base = c + 1;
+    }
+
+    l = dev9_append_string (devpath, l, sizeof (devpath), "/devices/virtual/");
+    l = dev9_append_string (devpath, l, sizeof (devpath), p->subsystem);
+    l = dev9_append_string (devpath, l, sizeof (devpath), "/");
+    l = dev9_append_string (devpath, l, sizeof (devpath), base);
+
+    if (l < 0)
+    {
+        return sx_end_of_list;
+    }
+
+    return cons (cons (sym_action, make_string ("add")),
+           cons (cons (sym_devpath, make_string (devpath)),
+           cons (cons (sym_devname, make_string (p->path)),
+           cons (cons (sym_subsystem, make_string (p->subsystem)),
+           cons (cons (sym_majour, number_string (p->majour)),
+           cons (cons (sym_minor, number_string (p->minor)),
+                 sx_end_of_list))))));
+}
+
+static void create_placeholder (struct dfs *fs, struct placeholder *p)
+{
+    struct dev9_device d =
+    {
+        .user         = "root",
+        .group        = "root",
+        .mode         = 0660,
+        .block_device = 0
+    };
+    struct dfs_device *n;
+
+    /* the placeholder gets the owner, group and mode the rules would give
+     * the real device, so that e.g. fuse and net/tun end up world-writable
+     * just like they will be after the driver is loaded */
+    dev9_rules_describe (placeholder_event (p), &d);
+
+    n = dev9_device_mknod (fs, p->path, d.block_device, p->majour, p->minor);
+
+    p->present = 0;
+
+    if (n != (struct dfs_device *)0)
+    {
+        n->c.uid  = (char *)d.user;
+        n->c.muid = (char *)d.user;
+        n->c.gid  = (char *)d.group;
+        n->c.mode = (n->c.mode & ~07777) | (d.mode & 07777);
+
+        /* views that select the device get the placeholder as well */
+        d.majour = p->majour;
+        d.minor  = p->minor;
+        dev9_views_add (&d, cons (make_string (p->path), sx_end_of_list));
+    }
+}
+
+void dev9_autoload_initialise (struct dfs *fs)
+{
+    static char registered = 0;
+    struct placeholder *p;
+
+    if (!registered)
+    {
+        dev9_statistics_register ("loads-started",   &loads_started);
+        dev9_statistics_register ("loads-succeeded", &loads_succeeded);
+        dev9_statistics_register ("loads-timed-out", &loads_timed_out);
+        registered = 1;
+    }
+
+    for (p = placeholders; p != (struct placeholder *)0; p = p->next)
+    {
+        create_placeholder (fs, p);
+    }
+}
+
+void dev9_autoload_restore (struct dfs *fs, int_16 majour, int_16 minor)
+{
+    struct placeholder *p;
+
+    for (p = placeholders; p != (struct placeholder *)0; p = p->next)
+    {
+        if ((p->majour == majour) && (p->minor == minor))
+        {
+            create_placeholder (fs, p);
+
+            /* the module was most likely unloaded along with the device,
+             * so the next walk should try to load it again */
+            if (p->module->state == ms_loaded)
+            {
+                p->module->state = ms_idle;
+            }
+        }
+    }
+}
+
+void dev9_autoload_arrived (int_16 majour, int_16 minor)
+{
+    struct placeholder *p;
+
+    for (p = placeholders; p != (struct placeholder *)0; p = p->next)
+    {
+        if ((p->majour == majour) && (p->minor == minor) && !p->present)
+        {
+            p->present = 1;
+            dev9_transport_release (majour, minor, 1);
+        }
+    }
+}
+
+/* fail the walks still waiting on any of the module's placeholders */
+static void give_up (struct module *m)
+{
+    struct placeholder *p;
+
+    for (p = placeholders; p != (struct placeholder *)0; p = p->next)
+    {
+        if ((p->module == m) && !p->present)
+        {
+            dev9_transport_release (p->majour, p->minor, 0);
+        }
+    }
+}
+
+static void on_loader_death (struct exec_context *cx, void *aux)
+{
+    struct module *m = (struct module *)aux;
+
+    /* a helper we've given up on and killed, the module may have been
+     * requested again since */
+    if (m->context != cx)
+    {
+        return;
+    }
+
+    m->context = (struct exec_context *)0;
+
+    if (cx->exitstatus == 0)
+    {
+        /* walks keep waiting for the device to be added, or the timer */
+        m->state = ms_loaded;
+        loads_succeeded++;
+    }
+    else
+    {
+        /* let the next request try again */
+        m->state = ms_idle;
+        give_up (m);
+    }
+}
+
+static void on_timeout (struct exec_context *cx, void *aux)
+{
+    struct module *m = (struct module *)aux;
+
+    /* superseded by the timer of a later load */
+    if (m->timer != cx)
+    {
+        return;
+    }
+
+    m->timer = (struct exec_context *)0;
+
+    if (m->state == ms_loading)
+    {
+        /* the helper is stuck, stop waiting for it */
+        sys_kill (m->context->pid, 9);
+        m->context = (struct exec_context *)0;
+        m->state   = ms_idle;
+        loads_timed_out++;
+    }
+
+    give_up (m);
+}
+
+/* a child that does nothing but sleep for the timeout, so the multiplexer
+ * tells us when it's up */
+static void start_timer (struct module *m)
+{
+    struct exec_context *context = execute (EXEC_CALL_NO_IO, (char **)0,
+                                            (char **)0);
+
+    switch (context->pid)
+    {
+        case 0:
+        {
+            struct timespec ts = { DEV9_AUTOLOAD_TIMEOUT, 0 };
+
+            while (sys_nanosleep (&ts, &ts) < 0);
+
+            cexit (0);
+        }
+        case -1:
+            m->timer = (struct exec_context *)0;
+            break;
+        default:
+            m->timer = context;
+            multiplex_add_process (context, on_timeout, (void *)m);
+    }
+}
+
+/* only one helper per module, no matter how many ask for it or through
+ * which of its nodes */
+static void load (struct module *m)
+{
+    struct exec_context *context;
+    char *argv[LOADER_ARGUMENTS];
+    unsigned int i;
+
+    if (m->state != ms_idle)
+    {
+        return;
+    }
+
+    for (i = 0; i < loader_arguments; i++)
+    {
+        argv[i] = (char *)loader[i];
+    }
+    argv[i]     = (char *)m->name;
+    argv[i + 1] = (char *)0;
+
+    context = execute (EXEC_CALL_NO_IO, argv, curie_environment);
+
+    if (context->pid > 0)
+    {
+        m->state   = ms_loading;
+        m->context = context;
+        loads_started++;
+        multiplex_add_process (context, on_loader_death, (void *)m);
+        start_timer (m);
+    }
+}
+
+void dev9_autoload_request (const char *name)
+{
+    struct placeholder *p;
+
+    for (p = placeholders; p != (struct placeholder *)0; p = p->next)
+    {
+        if (dev9_streq (p->path, name) || dev9_streq (p->module->name, name))
+        {
+            load (p->module);
+            return;
+        }
+    }
+}
+
+char dev9_autoload_walk (struct dfs_node_common *node)
+{
+    struct dfs_device *d = (struct dfs_device *)node;
+    struct placeholder *p;
+
+    for (p = placeholders; p != (struct placeholder *)0; p = p->next)
+    {
+        if (p->present || (d->majour != p->majour) || (d->minor != p->minor))
+        {
+            continue;
+        }
+
+        load (p->module);
+
+        /* a loader that has exited successfully may still be ahead of the
+         * kernel's uevent, so the walk waits for as long as the timer runs;
+         * without a loader or a timer there's nothing to wait for */
+        return (p->module->state != ms_idle) &&
+               (p->module->timer != (struct exec_context *)0);
+    }
+
+    return 0;
+}
@@ -0,0 +1,282 @@
+/*
+ * This file is part of the kyuba.org Dev9 project.
+ * See the appropriate repository at http://git.kyuba.org/ for exact file
+ * modification records.
+*/
+
+/*
+ * Copyright (c) 2008-2014, Kyuba Project Members
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+
+#include <dev9/batch.h>
+#include <dev9/rules.h>
+#include <dev9/devices.h>
+#include <dev9/events.h>
+#include <dev9/statistics.h>
+#include <dev9/sysfs.h>
+#include <curie/memory.h>
+#include <curie/tree.h>
+
+enum batch_action
+{
+    ba_other,
+    ba_add,
+    ba_change,
+    ba_remove
+};
+
+static struct pending
+{
+    sexpr attributes;
+    const char *devpath;
+    enum batch_action action;
+
+    struct pending *same;
+    struct pending *previous;
+    struct pending *next;
+} *first = (struct pending *)0, *last = (struct pending *)0;
+
+static struct memory_pool pool
+        = MEMORY_POOL_INITIALISER (sizeof (struct pending));
+
+/* DEVPATH -> the latest pending event for that DEVPATH */
+static struct tree devpaths = TREE_INITIALISER;
+
+static struct dfs *batch_fs = (struct dfs *)0;
+
+static int_64 events_received  = 0;
+static int_64 events_coalesced = 0;
+static int_64 events_applied   = 0;
+
+define_symbol (sym_devpath, "DEVPATH");
+define_symbol (sym_action,  "ACTION");
+
+static enum batch_action get_action (sexpr attributes)
+{
+    sexpr a = dev9_lookup_symbol (attributes, sym_action);
+
+    if (stringp(a))
+    {
+        const char *s = sx_string (a);
+
+        if (dev9_streq (s, "add"))    return ba_add;
+        if (dev9_streq (s, "change")) return ba_change;
+        if (dev9_streq (s, "remove")) return ba_remove;
+    }
+
+    return ba_other;
+}
+
+static void unlink_pending (struct pending *p)
+{
+    if (p->previous != (struct pending *)0)
+    {
+        p->previous->next = p->next;
+    }
+    else
+    {
+        first = p->next;
+    }
+
+    if (p->next != (struct pending *)0)
+    {
+        p->next->previous = p->previous;
+    }
+    else
+    {
+        last = p->previous;
+    }
+
+    p->previous = (struct pending *)0;
+    p->next     = (struct pending *)0;
+}
+
+static void append_pending (struct pending *p)
+{
+    p->previous = last;
+    p->next     = (struct pending *)0;
+
+    if (last != (struct pending *)0)
+    {
+        last->next = p;
+    }
+    else
+    {
+        first = p;
+    }
+
+    last = p;
+}
+
+static void set_latest (const char *devpath, struct pending *p)
+{
+    tree_remove_node_string (&devpaths, (char *)devpath);
+
+    if (p != (struct pending *)0)
+    {
+        tree_add_node_string_value (&devpaths, (char *)devpath, (void *)p);
+    }
+}
+
+void dev9_batch_add (sexpr attributes)
+{
+    static char registered = 0;
+    sexpr devpath = dev9_lookup_symbol (attributes, sym_devpath);
+    enum batch_action action = get_action (attributes);
+    struct pending *l = (struct pending *)0, *p;
+
+    if (!registered)
+    {
+        dev9_statistics_register ("events-received",  &events_received);
+        dev9_statistics_register ("events-coalesced", &events_coalesced);
+        dev9_statistics_register ("events-applied",   &events_applied);
+        registered = 1;
+    }
+
+    events_received++;
+
+    if (stringp(devpath))
+    {
+        /* whatever the device's attributes were, this event may have changed
+         * them */
+        dev9_sysfs_invalidate (sx_string (devpath));
+    }
+
+    /* have the workers read the attributes the rules are going to want
+     * while the event waits in the queue */
+    if (action != ba_remove)
+    {
+        (void)dev9_rules_ready (attributes);
+    }
+
+    if (stringp(devpath))
+    {
+        struct tree_node *n
+                = tree_get_node_string (&devpaths, (char *)sx_string (devpath));
+
+        if (n != (struct tree_node *)0)
+        {
+            l = (struct pending *)node_get_value (n);
+        }
+    }
+
+    if (l != (struct pending *)0)
+    {
+        if ((l->action == ba_add) && (action == ba_remove) &&
+            (l->same == (struct pending *)0) &&
+            (dev9_device_find (l->devpath) == (struct dev9_device *)0))
+        {
+            /* the device came and went within the batch: nothing to do */
+            unlink_pending (l);
+            set_latest (l->devpath, l->same);
+            free_pool_mem ((void *)l);
+            events_coalesced += 2;
+            return;
+        }
+
+        /* an add for a device we already know about, or that an earlier
+         * event in the batch will create, followed by a remove is as good
+         * as the remove */
+        if (((l->action == ba_add)    && (action == ba_change)) ||
+            ((l->action == ba_add)    && (action == ba_remove)) ||
+            ((l->action == ba_change) && (action == ba_change)) ||
+            ((l->action == ba_change) && (action == ba_remove)))
+        {
+            /* fold into the earlier event, which keeps its place in the
+             * queue, so nothing that arrived after it gets ahead of it;
+             * it only carries the latest attributes */
+            if ((l->action == ba_add) && (action == ba_change))
+            {
+                attributes = cons (cons (sym_action, make_string ("add")),
+                                   attributes);
+                action = ba_add;
+            }
+
+            l->attributes = attributes;
+            l->action     = action;
+
+            events_coalesced++;
+            return;
+        }
+    }
+
+    p = (struct pending *)get_pool_mem (&pool);
+
+    p->attributes = attributes;
+    p->action     = action;
+    p->devpath    = (const char *)0;
+    p->same       = l;
+
+    append_pending (p);
+
+    if (stringp(devpath))
+    {
+        p->devpath = sx_string (devpath);
+        set_latest (p->devpath, p);
+    }
+}
+
+void dev9_batch_flush (struct dfs *fs)
+{
+    batch_fs = fs;
+
+    while (first != (struct pending *)0)
+    {
+        struct pending *p = first;
+
+        /* the event is still waiting for attributes, and everything after
+         * it waits with it so the events are applied in order */
+        if ((p->action != ba_remove) && !dev9_rules_ready (p->attributes))
+        {
+            return;
+        }
+
+        unlink_pending (p);
+
+        if (p->devpath != (const char *)0)
+        {
+            struct tree_node *n
+                    = tree_get_node_string (&devpaths, (char *)p->devpath);
+
+            /* a later event for the DEVPATH may be waiting behind this
+             * one; that one stays the latest */
+            if ((n != (struct tree_node *)0) && (node_get_value (n) == p))
+            {
+                tree_remove_node_string (&devpaths, (char *)p->devpath);
+            }
+        }
+
+        dev9_events_record (p->attributes,
+                            dev9_rules_apply (p->attributes, fs));
+        events_applied++;
+
+        free_pool_mem ((void *)p);
+    }
+}
+
+void dev9_batch_resume (void)
+{
+    if (batch_fs != (struct dfs *)0)
+    {
+        dev9_batch_flush (batch_fs);
+    }
+}
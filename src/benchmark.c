@@ -0,0 +1,995 @@
+/*
+ * This file is part of the kyuba.org Dev9 project.
+ * See the appropriate repository at http://git.kyuba.org/ for exact file
+ * modification records.
+*/
+
+/*
+ * Copyright (c) 2008-2014, Kyuba Project Members
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+
+/* Micro-benchmarks for dev9's hot paths. Each benchmark runs once to warm up
+ * and then BENCHMARK_ROUNDS more times; the best and median time of those
+ * rounds are written to stdout as one S-expression per benchmark, e.g.
+ *   (benchmark "uevent-parse" (operations . 4096) (rounds . 9)
+ *              (best-ns . 812345) (median-ns . 830012))
+ * A (memory ...) record before those shows what the devices cost, see
+ * measure_memory. Rules files given on the command line replace the built-in
+ * rule set that is used for the mknod and walk benchmarks. Each mknod round starts from an
+ * empty tree; the walk benchmarks then talk 9p to the tree of the last round
+ * through a pair of pipes and dev9's relay, with one Twalk, Tstat and Tclunk
+ * per node, and the readdir benchmarks read the listings the relay serves.
+ * Pairs of benchmarks show what a mount gains from multi-component walks and
+ * from a larger msize:
+ *   walk-stat        the whole path in one Twalk, as the kernel sends it
+ *   walk-stat-components
+ *                    one Twalk per component
+ *   readdir          every directory listed with an msize of 131072, the
+ *                    kernel's default since 5.19
+ *   readdir-small-msize
+ *                    the same with 8192, the default of older kernels */
+
+#include <curie/main.h>
+#include <curie/multiplex.h>
+#include <curie/memory.h>
+#include <curie/regex.h>
+#include <curie/tree.h>
+
+#include <duat/filesystem.h>
+#include <duat/9p-server.h>
+
+#include <syscall/syscall.h>
+
+#include <dev9/devices.h>
+#include <dev9/rules.h>
+#include <dev9/uevent.h>
+#include <dev9/transport.h>
+
+#include <linux/time.h>
+#include <asm/fcntl.h>
+
+#define BENCHMARK_DEVICES 4096
+#define BENCHMARK_ROUNDS  9
+#define BENCHMARK_BUFFER  (1024*1024)
+#define BENCHMARK_CHUNK   4096
+#define BENCHMARK_REGEX   "(card|nvidia|3dfx|fb)[0-9]*"
+#define BENCHMARK_MESSAGE 8192
+#define BENCHMARK_MSIZE   131072
+#define BENCHMARK_MSIZE_SMALL 8192
+#define BENCHMARK_ROOT_FID 1
+#define BENCHMARK_FID      2
+
+#define NO_RESET ((void (*)(void))0)
+
+/* the few 9p message types and constants the walk benchmark needs */
+#define P9_TVERSION 100
+#define P9_RVERSION 101
+#define P9_TATTACH  104
+#define P9_RATTACH  105
+#define P9_TWALK    110
+#define P9_RWALK    111
+#define P9_TOPEN    112
+#define P9_ROPEN    113
+#define P9_TREAD    116
+#define P9_RREAD    117
+#define P9_TCLUNK   120
+#define P9_TSTAT    124
+#define P9_NOTAG    0xffff
+#define P9_NOFID    0xffffffffUL
+#define P9_MAXWELEM 16
+#define P9_IOHDRSZ  24
+
+static char uevents[BENCHMARK_BUFFER];
+static int_pointer uevents_length = 0;
+
+static char fragments[BENCHMARK_BUFFER];
+
+static sexpr events[BENCHMARK_DEVICES];
+static sexpr names[BENCHMARK_DEVICES];
+static unsigned int events_count = 0;
+
+static sexpr paths = sx_end_of_list;
+static sexpr regex = sx_nonexistent;
+
+static struct dfs *fs = (struct dfs *)0;
+static int_pointer operations = 0;
+
+define_symbol (sym_devpath,     "DEVPATH");
+define_symbol (sym_devbasepath, "DEV-BASE-PATH");
+define_symbol (sym_subsystem,   "SUBSYSTEM");
+define_symbol (sym_seqnum,      "SEQNUM");
+define_symbol (sym_minor,       "MINOR");
+define_symbol (sym_match,       "match");
+define_symbol (sym_when,        "when");
+define_symbol (sym_mknod,       "mknod");
+define_symbol (sym_benchmark,   "benchmark");
+define_symbol (sym_operations,  "operations");
+define_symbol (sym_rounds,      "rounds");
+define_symbol (sym_best,        "best-ns");
+define_symbol (sym_median,      "median-ns");
+define_symbol (sym_memory,      "memory");
+define_symbol (sym_devices,     "devices");
+define_symbol (sym_nodes,       "nodes");
+define_symbol (sym_directories, "directories");
+define_symbol (sym_entries,     "entries");
+define_symbol (sym_bytes,       "bytes");
+define_symbol (sym_per_device,  "bytes-per-device");
+
+static int_64 now (void)
+{
+    struct timespec ts;
+
+    sys_clock_gettime (CLOCK_MONOTONIC, &ts);
+
+    return ((int_64)ts.tv_sec * 1000000000) + (int_64)ts.tv_nsec;
+}
+
+static void append_string (const char *s)
+{
+    while ((*s != (char)0) && (uevents_length < (BENCHMARK_BUFFER - 1)))
+    {
+        uevents[uevents_length] = *s;
+        uevents_length++;
+        s++;
+    }
+}
+
+static void append_integer (unsigned int i)
+{
+    char digits[12];
+    int d = sizeof (digits) - 1;
+
+    digits[d] = (char)0;
+
+    do
+    {
+        d--;
+        digits[d] = '0' + (i % 10);
+        i /= 10;
+    } while ((i > 0) && (d > 0));
+
+    append_string (digits + d);
+}
+
+static void append_terminator (void)
+{
+    if (uevents_length < BENCHMARK_BUFFER)
+    {
+        uevents[uevents_length] = (char)0;
+        uevents_length++;
+    }
+}
+
+/* a mix of the kinds of devices a typical machine announces at coldplug */
+static void append_uevent (unsigned int i)
+{
+    static const char *subsystems[] = { "block", "input", "sound", "tty" };
+    static const char *prefixes[]   = { "sd", "event", "pcmC0D", "ttyS" };
+    static const char *parents[]    =
+    {
+        "/devices/pci0000:00/0000:00:1f.2/ata1/host0/target0:0:0/0:0:0:0/block/",
+        "/devices/pci0000:00/0000:00:14.0/usb1/1-1/1-1:1.0/input/input3/",
+        "/devices/pci0000:00/0000:00:1b.0/sound/card0/",
+        "/devices/platform/serial8250/tty/"
+    };
+    static const unsigned int majours[] = { 8, 13, 116, 4 };
+    unsigned int k = i % 4, n = i / 4;
+    int h;
+
+    for (h = 0; h < 2; h++)
+    {
+        /* header first, then the DEVPATH key with the same path */
+        append_string (h == 0 ? "add@" : "DEVPATH=");
+        append_string (parents[k]);
+        append_string (prefixes[k]);
+        append_integer (n);
+        append_terminator ();
+    }
+
+    append_string ("ACTION=add");
+    append_terminator ();
+    append_string ("SUBSYSTEM=");
+    append_string (subsystems[k]);
+    append_terminator ();
+    append_string ("MAJOR=");
+    append_integer (majours[k]);
+    append_terminator ();
+    append_string ("MINOR=");
+    append_integer (n);
+    append_terminator ();
+    append_string ("DEVNAME=");
+    append_string (prefixes[k]);
+    append_integer (n);
+    append_terminator ();
+    append_string ("SEQNUM=");
+    append_integer (1000 + i);
+    append_terminator ();
+}
+
+static void on_uevent_count (sexpr attributes, void *aux)
+{
+    operations++;
+}
+
+static void on_uevent_store (sexpr attributes, void *aux)
+{
+    if (events_count < BENCHMARK_DEVICES)
+    {
+        sexpr devpath = dev9_lookup_symbol (attributes, sym_devpath);
+        const char *x = sx_string (devpath), *y = x;
+
+        for (const char *c = x; (*c) != 0; c++)
+        {
+            if ((*c) == '/') y = c + 1;
+        }
+
+        events[events_count] = attributes;
+        names[events_count]  = make_string (y);
+        events_count++;
+    }
+}
+
+static void bench_uevent_parse (void)
+{
+    operations = 0;
+    (void)dev9_uevent_parse (uevents, uevents_length, on_uevent_count,
+                             (void *)0);
+}
+
+/* feed the same data in chunks that don't line up with the events, carrying
+ * incomplete events over to the next chunk like the netlink io does */
+static void bench_uevent_parse_fragmented (void)
+{
+    int_pointer pos = 0, pending = 0;
+
+    operations = 0;
+
+    while (pos < uevents_length)
+    {
+        int_pointer chunk = uevents_length - pos, consumed, i;
+
+        if (chunk > BENCHMARK_CHUNK) chunk = BENCHMARK_CHUNK;
+
+        for (i = 0; i < chunk; i++)
+        {
+            fragments[pending + i] = uevents[pos + i];
+        }
+
+        pos     += chunk;
+        pending += chunk;
+
+        consumed = dev9_uevent_parse (fragments, pending, on_uevent_count,
+                                      (void *)0);
+
+        for (i = consumed; i < pending; i++)
+        {
+            fragments[i - consumed] = fragments[i];
+        }
+
+        pending -= consumed;
+    }
+}
+
+static void bench_lookup_symbol (void)
+{
+    unsigned int i;
+
+    operations = 0;
+
+    for (i = 0; i < events_count; i++)
+    {
+        (void)dev9_lookup_symbol (events[i], sym_devpath);
+        (void)dev9_lookup_symbol (events[i], sym_subsystem);
+        (void)dev9_lookup_symbol (events[i], sym_minor);
+        (void)dev9_lookup_symbol (events[i], sym_seqnum);
+        operations += 4;
+    }
+}
+
+static void bench_regex_compile (void)
+{
+    unsigned int i;
+    sexpr s = make_string (BENCHMARK_REGEX);
+
+    operations = 0;
+
+    for (i = 0; i < 256; i++)
+    {
+        regex = rx_compile_sx (s);
+        operations++;
+    }
+}
+
+static void bench_regex_match (void)
+{
+    unsigned int i;
+
+    operations = 0;
+
+    for (i = 0; i < events_count; i++)
+    {
+        (void)rx_match_sx (regex, names[i]);
+        operations++;
+    }
+}
+
+/* forget the devices of the last round, so every round adds them to an
+ * empty tree; dropping the records unlinks their nodes and directories */
+static void reset_mknod (void)
+{
+    unsigned int i;
+
+    if (fs == (struct dfs *)0)
+    {
+        fs = dfs_create ((void *)0, (void *)0);
+        return;
+    }
+
+    for (i = 0; i < events_count; i++)
+    {
+        struct dev9_device *d = dev9_device_find
+                (sx_string (dev9_lookup_symbol (events[i], sym_devpath)));
+
+        if (d != (struct dev9_device *)0)
+        {
+            (void)dev9_device_drop (d, fs);
+        }
+    }
+}
+
+/* the resident set size in bytes, from VmRSS in /proc/self/status */
+static int_64 resident (void)
+{
+    char buf[4096];
+    int fd = sys_open ("/proc/self/status", O_RDONLY, 0), r, i;
+    int_64 kb = 0;
+
+    if (fd < 0)
+    {
+        return 0;
+    }
+
+    r = sys_read (fd, buf, sizeof (buf) - 1);
+    sys_close (fd);
+
+    if (r <= 0)
+    {
+        return 0;
+    }
+
+    buf[r] = (char)0;
+
+    for (i = 0; buf[i] != (char)0; i++)
+    {
+        if ((buf[i] == 'V') && (buf[i+1] == 'm') && (buf[i+2] == 'R') &&
+            (buf[i+3] == 'S') && (buf[i+4] == 'S') && (buf[i+5] == ':'))
+        {
+            for (i += 6; (buf[i] == ' ') || (buf[i] == '\t'); i++);
+
+            for (; (buf[i] >= '0') && (buf[i] <= '9'); i++)
+            {
+                kb = (kb * 10) + (buf[i] - '0');
+            }
+
+            break;
+        }
+    }
+
+    return kb * 1024;
+}
+
+/* what the devices cost: the growth of the resident set while every device
+ * is added to an empty tree, and the nodes and listing entries dev9 keeps
+ * for them. This runs before any other round, so no node is handed out a
+ * second time, and it's written out as e.g.
+ *   (memory "devices" (devices . 4096) (nodes . 4096) (directories . 12)
+ *           (entries . 12288) (bytes . 2711552) (bytes-per-device . 662)) */
+static void measure_memory (struct sexpr_io *out)
+{
+    struct dev9_device_usage usage;
+    int_64 before, after;
+    unsigned int i;
+
+    reset_mknod ();
+
+    before = resident ();
+
+    for (i = 0; i < events_count; i++)
+    {
+        (void)dev9_rules_apply (events[i], fs);
+    }
+
+    after = resident ();
+
+    dev9_device_usage (&usage);
+
+    sx_write (out, cons (sym_memory,
+                   cons (make_string ("devices"),
+                   cons (cons (sym_devices, make_integer (usage.devices)),
+                   cons (cons (sym_nodes, make_integer (usage.nodes)),
+                   cons (cons (sym_directories,
+                               make_integer (usage.directories)),
+                   cons (cons (sym_entries, make_integer (usage.entries)),
+                   cons (cons (sym_bytes, make_integer (after - before)),
+                   cons (cons (sym_per_device,
+                               make_integer ((usage.devices > 0)
+                                   ? ((after - before) / usage.devices)
+                                   : 0)),
+                         sx_end_of_list)))))))));
+}
+
+static void bench_mknod (void)
+{
+    unsigned int i;
+
+    paths = sx_end_of_list;
+    operations = 0;
+
+    for (i = 0; i < events_count; i++)
+    {
+        sexpr nodes = dev9_rules_apply (events[i], fs);
+
+        while (consp(nodes))
+        {
+            paths = cons (car (nodes), paths);
+            nodes = cdr (nodes);
+        }
+
+        operations++;
+    }
+}
+
+/* a minimal 9p client, talking to dev9's tree through a pair of pipes the
+ * same way the kernel does after a mount with -m */
+struct connection
+{
+    int request;
+    int_32 replies;
+    char connected;
+    unsigned long msize;
+
+    /* the last reply's type, and the first bytes after its tag */
+    char type;
+    char body[4];
+};
+
+static struct connection connection;
+static struct connection connection_small;
+
+/* the directories the nodes are in, for the readdir benchmarks */
+static sexpr directories = sx_end_of_list;
+
+static unsigned char message[BENCHMARK_MESSAGE];
+static int_32 message_length = 0;
+
+static void put_8 (unsigned int v)
+{
+    if (message_length < BENCHMARK_MESSAGE)
+    {
+        message[message_length] = (unsigned char)v;
+        message_length++;
+    }
+}
+
+static void put_16 (unsigned int v)
+{
+    put_8 (v);
+    put_8 (v >> 8);
+}
+
+static void put_32 (unsigned long v)
+{
+    put_16 (v);
+    put_16 (v >> 16);
+}
+
+static void put_64 (int_64 v)
+{
+    put_32 ((unsigned long)(v & 0xffffffff));
+    put_32 ((unsigned long)((v >> 32) & 0xffffffff));
+}
+
+static void put_string (const char *s, int_32 length)
+{
+    int_32 i;
+
+    put_16 (length);
+
+    for (i = 0; i < length; i++)
+    {
+        put_8 ((unsigned char)s[i]);
+    }
+}
+
+static void begin (unsigned int type, unsigned int tag)
+{
+    message_length = 4;
+    put_8 (type);
+    put_16 (tag);
+}
+
+static unsigned int get_16 (const char *b)
+{
+    const unsigned char *u = (const unsigned char *)b;
+
+    return (unsigned int)u[0] | ((unsigned int)u[1] << 8);
+}
+
+static unsigned long get_32 (const char *b)
+{
+    return (unsigned long)get_16 (b) | ((unsigned long)get_16 (b + 2) << 16);
+}
+
+static void on_reply (struct io *io, void *aux)
+{
+    struct connection *c = (struct connection *)aux;
+    int i;
+
+    while ((io->length - io->position) >= 7)
+    {
+        const char *b = io->buffer + io->position;
+        unsigned long size = get_32 (b);
+
+        if (size < 7)
+        {
+            c->connected = 0;
+            return;
+        }
+
+        if ((io->length - io->position) < size)
+        {
+            break;
+        }
+
+        c->type = b[4];
+
+        for (i = 0; i < 4; i++)
+        {
+            c->body[i] = ((unsigned long)(7 + i) < size) ? b[7 + i] : 0;
+        }
+
+        c->replies++;
+
+        io->position += size;
+    }
+}
+
+static void on_reply_close (struct io *io, void *aux)
+{
+    ((struct connection *)aux)->connected = 0;
+}
+
+/* send the message and wait for its reply; returns the reply's type */
+static char transact (struct connection *c)
+{
+    int_32 wanted = c->replies + 1, pos = 0;
+
+    message[0] = (unsigned char)message_length;
+    message[1] = (unsigned char)(message_length >> 8);
+    message[2] = (unsigned char)(message_length >> 16);
+    message[3] = (unsigned char)(message_length >> 24);
+
+    while (pos < message_length)
+    {
+        int r = sys_write (c->request, message + pos, message_length - pos);
+
+        if (r <= 0) return 0;
+
+        pos += r;
+    }
+
+    while (c->connected && (c->replies < wanted))
+    {
+        multiplex ();
+    }
+
+    return c->connected ? c->type : 0;
+}
+
+static char connect_9p (struct connection *c, unsigned long msize)
+{
+    int fdi[2], fdo[2];
+    struct io *replies;
+
+    if ((sys_pipe (fdi) == -1) || (sys_pipe (fdo) == -1))
+    {
+        return 0;
+    }
+
+    dev9_transport_add_io (io_open (fdi[0]), io_open (fdo[1]), fs);
+
+    replies = io_open (fdo[0]);
+    replies->type = iot_read;
+
+    c->request   = fdi[1];
+    c->replies   = 0;
+    c->connected = 1;
+    c->type      = 0;
+
+    multiplex_add_io (replies, on_reply, on_reply_close, (void *)c);
+
+    begin (P9_TVERSION, P9_NOTAG);
+    put_32 (msize);
+    put_string ("9P2000", 6);
+
+    if (transact (c) != P9_RVERSION) return 0;
+
+    c->msize = get_32 (c->body);
+
+    begin (P9_TATTACH, 1);
+    put_32 (BENCHMARK_ROOT_FID);
+    put_32 (P9_NOFID);
+    put_string ("root", 4);
+    put_string ("", 0);
+
+    return transact (c) == P9_RATTACH;
+}
+
+static void clunk (struct connection *c, unsigned int fid)
+{
+    begin (P9_TCLUNK, 1);
+    put_32 (fid);
+    (void)transact (c);
+}
+
+/* walk from the root to the path with up to the given number of components
+ * per Twalk; returns 1 if newfid refers to the path afterwards */
+static char walk
+        (struct connection *c, const char *path, unsigned int per_walk)
+{
+    const char *components[P9_MAXWELEM];
+    int_32 lengths[P9_MAXWELEM];
+    unsigned int fid = BENCHMARK_ROOT_FID, n, i;
+
+    if (per_walk > P9_MAXWELEM)
+    {
+        per_walk = P9_MAXWELEM;
+    }
+
+    /* the root itself takes one Twalk without any names */
+    do
+    {
+        for (n = 0; (n < per_walk) && (*path != (char)0); )
+        {
+            const char *s = path;
+
+            while ((*path != (char)0) && (*path != '/')) path++;
+
+            if (path > s)
+            {
+                components[n] = s;
+                lengths[n]    = path - s;
+                n++;
+            }
+
+            if (*path == '/') path++;
+        }
+
+        begin (P9_TWALK, 1);
+        put_32 (fid);
+        put_32 (BENCHMARK_FID);
+        put_16 (n);
+
+        for (i = 0; i < n; i++)
+        {
+            put_string (components[i], lengths[i]);
+        }
+
+        /* a short walk leaves newfid alone, unless it's the fid we walked
+         * from */
+        if ((transact (c) != P9_RWALK) ||
+            (get_16 (c->body) != n))
+        {
+            if (fid == BENCHMARK_FID) clunk (c, BENCHMARK_FID);
+            return 0;
+        }
+
+        fid = BENCHMARK_FID;
+    } while (*path != (char)0);
+
+    return 1;
+}
+
+/* walk to every node the rules created and stat it, over 9p */
+static void walk_stat (unsigned int per_walk)
+{
+    sexpr cur;
+
+    operations = 0;
+
+    if (!connection.connected)
+    {
+        return;
+    }
+
+    for (cur = paths; consp(cur); cur = cdr (cur))
+    {
+        if (walk (&connection, sx_string (car (cur)), per_walk))
+        {
+            begin (P9_TSTAT, 1);
+            put_32 (BENCHMARK_FID);
+            (void)transact (&connection);
+
+            clunk (&connection, BENCHMARK_FID);
+        }
+
+        operations++;
+    }
+}
+
+/* the whole path in one Twalk, as the kernel sends it */
+static void bench_walk_stat (void)
+{
+    walk_stat (P9_MAXWELEM);
+}
+
+/* one Twalk per path component, for comparison: what every lookup costs
+ * without multi-component walks */
+static void bench_walk_stat_components (void)
+{
+    walk_stat (1);
+}
+
+static void collect_directories (void)
+{
+    sexpr cur;
+
+    directories = cons (make_string (""), sx_end_of_list);
+
+    for (cur = paths; consp(cur); cur = cdr (cur))
+    {
+        char buf[DEV9_PATH_MAX];
+        const char *s = sx_string (car (cur));
+        int_32 i, slash = -1;
+        sexpr d, known;
+
+        for (i = 0; (s[i] != (char)0) && (i < (DEV9_PATH_MAX - 1)); i++)
+        {
+            buf[i] = s[i];
+            if (s[i] == '/') slash = i;
+        }
+
+        if (slash <= 0) continue;
+
+        buf[slash] = (char)0;
+        d = make_string (buf);
+
+        for (known = directories; consp(known); known = cdr (known))
+        {
+            if (truep(equalp(car (known), d))) break;
+        }
+
+        if (!consp(known))
+        {
+            directories = cons (d, directories);
+        }
+    }
+}
+
+/* list every directory with as many entries per Rread as the msize allows */
+static void list_directories (struct connection *c)
+{
+    sexpr cur;
+
+    operations = 0;
+
+    if (!c->connected)
+    {
+        return;
+    }
+
+    for (cur = directories; consp(cur); cur = cdr (cur))
+    {
+        int_64 offset = 0;
+
+        if (!walk (c, sx_string (car (cur)), P9_MAXWELEM)) continue;
+
+        begin (P9_TOPEN, 1);
+        put_32 (BENCHMARK_FID);
+        put_8 (0);
+
+        if (transact (c) == P9_ROPEN)
+        {
+            unsigned long count;
+
+            do
+            {
+                begin (P9_TREAD, 1);
+                put_32 (BENCHMARK_FID);
+                put_64 (offset);
+                put_32 (c->msize - P9_IOHDRSZ);
+
+                if (transact (c) != P9_RREAD) break;
+
+                count   = get_32 (c->body);
+                offset += count;
+                operations++;
+            } while (count > 0);
+        }
+
+        clunk (c, BENCHMARK_FID);
+    }
+}
+
+static void bench_readdir (void)
+{
+    list_directories (&connection);
+}
+
+static void bench_readdir_small (void)
+{
+    list_directories (&connection_small);
+}
+
+/* reset, if given, runs before every round without being timed */
+static void run
+        (struct sexpr_io *out, const char *name, void (*benchmark)(void),
+         void (*reset)(void))
+{
+    int_64 samples[BENCHMARK_ROUNDS];
+    int i, j;
+
+    if (reset != (void (*)(void))0) reset ();
+
+    benchmark ();
+
+    for (i = 0; i < BENCHMARK_ROUNDS; i++)
+    {
+        int_64 start;
+
+        if (reset != (void (*)(void))0) reset ();
+
+        start = now ();
+
+        benchmark ();
+
+        samples[i] = now () - start;
+    }
+
+    for (i = 1; i < BENCHMARK_ROUNDS; i++)
+    {
+        int_64 t = samples[i];
+
+        for (j = i; (j > 0) && (samples[j-1] > t); j--)
+        {
+            samples[j] = samples[j-1];
+        }
+
+        samples[j] = t;
+    }
+
+    sx_write (out, cons (sym_benchmark,
+                   cons (make_string (name),
+                   cons (cons (sym_operations, make_integer (operations)),
+                   cons (cons (sym_rounds, make_integer (BENCHMARK_ROUNDS)),
+                   cons (cons (sym_best, make_integer (samples[0])),
+                   cons (cons (sym_median,
+                               make_integer (samples[BENCHMARK_ROUNDS / 2])),
+                         sx_end_of_list)))))));
+}
+
+static sexpr list2 (sexpr a, sexpr b)
+{
+    return cons (a, cons (b, sx_end_of_list));
+}
+
+static void add_default_rules (void)
+{
+    dev9_rules_add (list2 (sym_mknod, sym_devbasepath), (struct sexpr_io *)0);
+
+    dev9_rules_add
+        (cons (sym_when,
+               list2 (list2 (sym_match,
+                             cons (sym_subsystem, make_string ("input"))),
+                      cons (sym_mknod,
+                            list2 (make_string ("input"), sym_devbasepath)))),
+         (struct sexpr_io *)0);
+
+    dev9_rules_add
+        (cons (sym_when,
+               list2 (list2 (sym_match,
+                             cons (sym_subsystem, make_string ("sound"))),
+                      cons (sym_mknod,
+                            list2 (make_string ("snd"), sym_devbasepath)))),
+         (struct sexpr_io *)0);
+
+    dev9_rules_add
+        (cons (sym_when,
+               list2 (list2 (sym_match,
+                             cons (sym_subsystem, make_string (".+"))),
+                      cons (sym_mknod,
+                            cons (make_string (".all"),
+                                  list2 (sym_subsystem, sym_devbasepath))))),
+         (struct sexpr_io *)0);
+}
+
+static void on_rules_read (sexpr sx, struct sexpr_io *io, void *unused)
+{
+    dev9_rules_add (sx, io);
+}
+
+int cmain ()
+{
+    struct sexpr_io *out;
+    unsigned int i;
+    char had_rules_file = 0;
+
+    multiplex_io ();
+    dfs_update_ids ();
+    multiplex_sexpr ();
+
+    for (i = 1; curie_argv[i]; i++)
+    {
+        multiplex_add_sexpr (sx_open_io (io_open_read (curie_argv[i]),
+                                         io_open (-1)),
+                             on_rules_read, (void *)0);
+        while (multiplex() != mx_nothing_to_do);
+        had_rules_file = 1;
+    }
+
+    if (!had_rules_file)
+    {
+        add_default_rules ();
+    }
+
+    for (i = 0; i < BENCHMARK_DEVICES; i++)
+    {
+        append_uevent (i);
+    }
+
+    (void)dev9_uevent_parse (uevents, uevents_length, on_uevent_store,
+                             (void *)0);
+
+    out = sx_open_io (io_open (-1), io_open (1));
+
+    run (out, "uevent-parse",            bench_uevent_parse, NO_RESET);
+    run (out, "uevent-parse-fragmented", bench_uevent_parse_fragmented,
+         NO_RESET);
+    run (out, "lookup-symbol",           bench_lookup_symbol, NO_RESET);
+    run (out, "regex-compile",           bench_regex_compile, NO_RESET);
+    run (out, "regex-match",             bench_regex_match, NO_RESET);
+    measure_memory (out);
+
+    run (out, "mknod",                   bench_mknod, reset_mknod);
+
+    multiplex_d9s ();
+
+    if (connect_9p (&connection, BENCHMARK_MSIZE))
+    {
+        run (out, "walk-stat",           bench_walk_stat, NO_RESET);
+        run (out, "walk-stat-components", bench_walk_stat_components,
+             NO_RESET);
+
+        collect_directories ();
+
+        run (out, "readdir",             bench_readdir, NO_RESET);
+
+        if (connect_9p (&connection_small, BENCHMARK_MSIZE_SMALL))
+        {
+            run (out, "readdir-small-msize", bench_readdir_small, NO_RESET);
+        }
+    }
+
+    sx_close_io (out);
+
+    return 0;
+}
@@ -32,6 +32,9 @@
 #include <curie/multiplex.h>
 #include <curie/memory.h>
 #include <curie/directory.h>
+#include <curie/network.h>
+
+#include <sievert/immutable.h>
 
 #include <duat/9p-server.h>
 #include <duat/filesystem.h>
@@ -39,6 +42,15 @@
 #include <syscall/syscall.h>
 
 #include <dev9/rules.h>
+#include <dev9/events.h>
+#include <dev9/batch.h>
+#include <dev9/statistics.h>
+#include <dev9/autoload.h>
+#include <dev9/query.h>
+#include <dev9/uevent.h>
+#include <dev9/probe.h>
+#include <dev9/views.h>
+#include <dev9/transport.h>
 
 #include <sys/types.h>
 #include <asm/types.h>
@@ -48,7 +60,8 @@
 
 #define HELPTEXT\
         "dev9-1\n"\
-        "Usage: dev9 [-opmih] [rules-file ...] [-s socket-name]\n"\
+        "Usage: dev9 [-opmihf] [rules-file ...] [-s socket-name]\n"\
+        "            [-M msize] [-O mount-options]\n"\
         "\n"\
         " -o          Talk 9p on stdio\n"\
         " -s          Talk 9p on the supplied socket-name\n"\
@@ -57,6 +70,9 @@
         " -i          Initialise common nodes under /dev.\n"\
         " -h          Print this and exit.\n"\
         " -f          Don't detach and creep into the background.\n"\
+        " -M          9p msize to use with -m, defaults to the kernel's\n"\
+        " -O          Additional 9p mount options to use with -m, e.g.\n"\
+        "             cache=loose,version=9p2000.u\n"\
         "\n"\
         " rules-file  The rules file to use, defaults to " DEFAULT_RULES "\n"\
         " socket-name The socket to use, defaults to\n"\
@@ -72,6 +88,12 @@
 
 #define DEFAULT_RULES ETCDIR "rules.sx"
 
+/* mount options for -m; options set on the command line are pinned, so the
+ * rules files can't override them. Options with an empty value are flags,
+ * e.g. posixacl or nodevmap. */
+#define MOUNT_OPTIONS_MAX    16
+#define MOUNT_OPTIONS_LENGTH 512
+
 /* This is probably a bit excessive, but better safe than sorry right now. */
 #define NETLINK_BUFFER (1024*1024*32)
 
@@ -80,85 +102,181 @@ static struct sexpr_io *queue;
 static struct io *queue_io;
 
 define_symbol (sym_disable, "disable");
+define_symbol (sym_mount_option, "mount-option");
+define_symbol (sym_placeholder,  "placeholder");
+define_symbol (sym_loader,       "loader");
+define_symbol (sym_load,         "load");
+define_symbol (sym_query,        "query");
+define_symbol (sym_identity_probe, "identity-probe");
+define_symbol (sym_view,         "view");
+
+static struct mount_option
+{
+    const char *name;
+    const char *value;
+    char pinned;
+} mount_options[MOUNT_OPTIONS_MAX];
+static int mount_options_count = 0;
 
-static void ping_for_uevents (const char *dir) {
-    sexpr ueventfiles = read_directory (dir);
+static char mount_option_valid (const char *s)
+{
+    if (*s == (char)0) return 0;
 
-    for (sexpr x = ueventfiles; consp(x); x = cdr (x))
+    for (; *s != (char)0; s++)
     {
-        sexpr xcar = car(x);
-        int f = sys_open (sx_string(xcar), O_WRONLY, 0);
+        char c = *s;
 
-        if (f >= 0) {
-            sys_write (f, "add\n", 4);
-            sys_close (f);
+        if (!(((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) ||
+              ((c >= '0') && (c <= '9')) ||
+              (c == '_') || (c == '.') || (c == '-') || (c == ':') ||
+              (c == '/')))
+        {
+            return 0;
         }
     }
+
+    return 1;
 }
 
-static void on_netlink_read(struct io *io, void *fsv)
+static void set_mount_option (const char *name, const char *value, char pin)
 {
-    struct dfs *fs = (struct dfs *)fsv;
-    char *b = io->buffer,
-         *fragment_header = b,
-         *is = b,
-         *ms = b,
-         *i = b,
-         *max = (b + io->length),
-         frag_boundary = 0;
-    sexpr attributes = sx_end_of_list;
-
-    while (i < max)
+    int i;
+
+    /* these tie the mount to our pipes, so they're not up for grabs */
+    if (!mount_option_valid (name) ||
+        ((*value != (char)0) && !mount_option_valid (value)) ||
+        dev9_streq (name, "trans") || dev9_streq (name, "rfdno") ||
+        dev9_streq (name, "wfdno"))
     {
-        frag_boundary = 0;
+        return;
+    }
 
-        switch (*i)
+    if (dev9_streq (name, "msize"))
+    {
+        const char *c;
+
+        if (*value == (char)0) return;
+
+        for (c = value; *c != (char)0; c++)
         {
-            case 0:
-                if (i == (max - 1)) /* definitely a fragment end */
-                {
-                    frag_boundary = 1;
-                }
+            if ((*c < '0') || (*c > '9')) return;
+        }
+    }
 
-                if (is == ms) /* fragment header */
-                {
-                    if (is != b) /* first fragment header: nothing to examine */
-                    {
-                        attributes = cons(make_symbol (fragment_header), attributes);
-                        dev9_rules_apply (attributes, fs);
-                    }
-                    fragment_header = is;
-                    attributes = sx_end_of_list;
-                }
-                else /* key/value pair */
-                {
-                    *ms = 0;
-                    attributes = cons (cons(make_symbol(is),
-                                            make_string(ms+1)),
-                                       attributes);
-                    *ms = '=';
-                }
+    for (i = 0; i < mount_options_count; i++)
+    {
+        if (dev9_streq (mount_options[i].name, name))
+        {
+            if (mount_options[i].pinned && !pin) return;
+            break;
+        }
+    }
 
-                i++;
-                is = ms = i;
-                break;
-            case '=':
-                if (ms == is) ms = i;
+    if (i == MOUNT_OPTIONS_MAX) return;
+    if (i == mount_options_count) mount_options_count++;
+
+    mount_options[i].name   = str_immutable (name);
+    mount_options[i].value  = str_immutable (value);
+    mount_options[i].pinned = pin;
+}
+
+/* parse "key=value,key=value,..." as given to -O */
+static void set_mount_options (const char *s, char pin)
+{
+    char name[MOUNT_OPTIONS_LENGTH], value[MOUNT_OPTIONS_LENGTH];
+
+    while (*s != (char)0)
+    {
+        int n = 0, v = 0;
+
+        while ((*s != (char)0) && (*s != '=') && (*s != ',') &&
+               (n < (MOUNT_OPTIONS_LENGTH - 1)))
+        {
+            name[n] = *s; n++; s++;
+        }
+        name[n] = (char)0;
+
+        if (*s == '=')
+        {
+            s++;
+            while ((*s != (char)0) && (*s != ',') &&
+                   (v < (MOUNT_OPTIONS_LENGTH - 1)))
+            {
+                value[v] = *s; v++; s++;
+            }
         }
+        value[v] = (char)0;
 
-        i++;
+        while ((*s != (char)0) && (*s != ',')) s++;
+        if (*s == ',') s++;
+
+        if (n > 0)
+        {
+            set_mount_option (name, value, pin);
+        }
     }
+}
+
+static int build_mount_options (char *buf, int size, int rfd, int wfd)
+{
+    int i, pos = 0;
+
+    pos = dev9_append_string  (buf, pos, size, "trans=fd,rfdno=");
+    pos = dev9_append_integer (buf, pos, size, rfd);
+    pos = dev9_append_string  (buf, pos, size, ",wfdno=");
+    pos = dev9_append_integer (buf, pos, size, wfd);
 
-    if (frag_boundary)
+    for (i = 0; i < mount_options_count; i++)
     {
-        attributes = cons(make_symbol (fragment_header), attributes);
-        dev9_rules_apply (attributes, fs);
-        io->position += io->length;
+        pos = dev9_append_string (buf, pos, size, ",");
+        pos = dev9_append_string (buf, pos, size, mount_options[i].name);
+
+        if (mount_options[i].value[0] != (char)0)
+        {
+            pos = dev9_append_string (buf, pos, size, "=");
+            pos = dev9_append_string (buf, pos, size, mount_options[i].value);
+        }
+    }
+
+    return pos;
+}
+
+static void ping_for_uevents (const char *dir) {
+    sexpr ueventfiles = read_directory (dir);
+
+    for (sexpr x = ueventfiles; consp(x); x = cdr (x))
+    {
+        sexpr xcar = car(x);
+        int f = sys_open (sx_string(xcar), O_WRONLY, 0);
+
+        if (f >= 0) {
+            sys_write (f, "add\n", 4);
+            sys_close (f);
+        }
     }
-    else
+}
+
+static void on_uevent (sexpr attributes, void *aux)
+{
+    dev9_batch_add (attributes);
+}
+
+static void on_netlink_read(struct io *io, void *fsv)
+{
+    struct dfs *fs = (struct dfs *)fsv;
+
+    /* the socket is non-blocking, so keep reading until the kernel has
+     * nothing more queued; everything that came in as a burst ends up in
+     * the same batch instead of one batch per read */
+    do
     {
-        io->position += (int_pointer)(max - fragment_header);
+        io->position += dev9_uevent_parse (io->buffer + io->position,
+                                           io->length - io->position,
+                                           on_uevent, (void *)0);
     }
+    while (io_read (io) == io_changes);
+
+    dev9_batch_flush (fs);
 
     optimise_static_memory_pools();
     io_flush (io);
@@ -176,6 +294,14 @@ static void mx_on_subprocess_death(struct exec_context *cx, void *d)
         cexit (26);
 }
 
+/* the device nodes the probe workers couldn't open while /dev wasn't
+ * mounted can be opened now */
+static void on_mounted(struct exec_context *cx, void *d)
+{
+    mx_on_subprocess_death (cx, d);
+    dev9_probe_retry ();
+}
+
 static void connect_to_netlink(struct dfs *fs)
 {
     struct sockaddr_nl nls = { 0, 0, 0, 0 };
@@ -229,6 +355,60 @@ static void connect_to_netlink(struct dfs *fs)
 
 static void on_rules_read(sexpr sx, struct sexpr_io *io, void *unused)
 {
+    if (consp(sx) && truep(equalp(car(sx), sym_mount_option)))
+    {
+        /* (mount-option msize 131072), (mount-option "cache" "loose") or
+         * just (mount-option posixacl) */
+        sexpr name  = car (cdr (sx));
+        sexpr value = car (cdr (cdr (sx)));
+        char buf[16];
+        const char *n = symbolp(name)  ? sx_symbol (name)
+                      : stringp(name)  ? sx_string (name)
+                      : (const char *)0;
+        const char *v = !consp(cdr (cdr (sx))) ? ""
+                      : symbolp(value) ? sx_symbol (value)
+                      : stringp(value) ? sx_string (value)
+                      : (const char *)0;
+
+        if (integerp(value) && (sx_integer (value) >= 0))
+        {
+            v = (dev9_append_integer (buf, 0, sizeof (buf),
+                                      sx_integer (value)) < 0)
+              ? (const char *)0 : buf;
+        }
+
+        if ((n != (const char *)0) && (v != (const char *)0))
+        {
+            set_mount_option (n, v, 0);
+        }
+
+        return;
+    }
+
+    if (consp(sx) && truep(equalp(car(sx), sym_placeholder)))
+    {
+        dev9_autoload_add (cdr (sx));
+        return;
+    }
+
+    if (consp(sx) && truep(equalp(car(sx), sym_loader)))
+    {
+        dev9_autoload_set_loader (cdr (sx));
+        return;
+    }
+
+    if (consp(sx) && truep(equalp(car(sx), sym_identity_probe)))
+    {
+        dev9_probe_configure (cdr (sx));
+        return;
+    }
+
+    if (consp(sx) && truep(equalp(car(sx), sym_view)))
+    {
+        dev9_view_add (cdr (sx));
+        return;
+    }
+
     dev9_rules_add (sx, io);
 }
 
@@ -241,6 +421,19 @@ static void mx_sx_ctl_queue_read (sexpr sx, struct sexpr_io *io, void *aux)
         {
             cexit (0);
         }
+        else if (truep(equalp(sxcar, sym_load)))
+        {
+            sexpr name = car (cdr (sx));
+
+            if (stringp(name))
+            {
+                dev9_autoload_request (sx_string (name));
+            }
+        }
+        else if (truep(equalp(sxcar, sym_query)))
+        {
+            dev9_query_add (cdr (sx));
+        }
     }
 }
 
@@ -252,6 +445,63 @@ static int_32 on_control_write
     return length;
 }
 
+/* mount a dfs through a pair of pipes, from a child process so that we can
+ * keep serving the requests that the mount itself causes */
+static void mount_dfs
+        (struct dfs *fs, const char *mountpoint, char initialise_common)
+{
+    char options[MOUNT_OPTIONS_LENGTH];
+    char path[MOUNT_OPTIONS_LENGTH];
+    struct io *in, *out;
+    int fdi[2], fdo[2];
+
+    if ((sys_pipe (fdi) != -1) && (sys_pipe (fdo) != -1))
+    {
+        struct exec_context *context;
+        in  = io_open(fdi[0]);
+        out = io_open(fdo[1]);
+
+        dev9_transport_add_io (in, out, fs);
+
+        if (build_mount_options (options, sizeof (options),
+                                 fdo[0], fdi[1]) > 0)
+        {
+            context = execute(EXEC_CALL_NO_IO, (char **)0, (char **)0);
+            switch (context->pid)
+            {
+                case -1:
+                    cexit (30);
+                case 0:
+                    sys_close (fdi[0]);
+                    sys_close (fdo[1]);
+                    sys_mount ("dev9", (char *)mountpoint, "9p", 0, options);
+                    if (initialise_common &&
+                        (dev9_append_string
+                             (path, dev9_append_string
+                                        (path, 0, sizeof (path), mountpoint),
+                              sizeof (path), "/pts") > 0))
+                    {
+                        sys_mount ("devpts", path, "devpts", 0, (void *)0);
+
+                        if (dev9_append_string
+                                (path, dev9_append_string
+                                           (path, 0, sizeof (path),
+                                            mountpoint),
+                                 sizeof (path), "/shm") > 0)
+                        {
+                            sys_mount ("shm", path, "tmpfs", 0, (void *)0);
+                        }
+                    }
+                    cexit (0);
+                default:
+                    sys_close (fdo[0]);
+                    sys_close (fdi[1]);
+                    multiplex_add_process(context, on_mounted, (void *)0);
+            }
+        }
+    }
+}
+
 static void print_help()
 {
     sys_write (1, HELPTEXT, sizeof (HELPTEXT));
@@ -265,9 +515,12 @@ int cmain() {
     char mount_self = 0;
     char *use_socket = (char *)0;
     char next_socket = 0;
+    char next_msize = 0;
+    char next_options = 0;
     char had_rules_file = 0;
     char initialise_common = 0;
     char o_foreground = 0;
+    struct dev9_view *view;
 
 //    terminate_on_allocation_errors();
 
@@ -276,6 +529,8 @@ int cmain() {
 
     multiplex_sexpr();
 
+    set_mount_option ("access", "any", 0);
+
     for (i = 1; curie_argv[i]; i++) {
         if (curie_argv[i][0] == '-')
         {
@@ -292,6 +547,8 @@ int cmain() {
                     case 'm': mount_self = 1; break;
                     case 's': next_socket = 1; break;
                     case 'f': o_foreground = 1; break;
+                    case 'M': next_msize = 1; break;
+                    case 'O': next_options = 1; break;
                     default:
                         print_help();
                 }
@@ -306,6 +563,20 @@ int cmain() {
             continue;
         }
 
+        if (next_msize)
+        {
+            set_mount_option ("msize", curie_argv[i], 1);
+            next_msize = 0;
+            continue;
+        }
+
+        if (next_options)
+        {
+            set_mount_options (curie_argv[i], 1);
+            next_options = 0;
+            continue;
+        }
+
         multiplex_add_sexpr(sx_open_io (io_open_read (curie_argv[i]),
                                         io_open (-1)),
                             on_rules_read, (void *)0);
@@ -325,12 +596,36 @@ int cmain() {
         while (multiplex() != mx_nothing_to_do);
     }
 
+    if ((use_stdio == 0) && (o_foreground == 0))
+    {
+        struct exec_context *context
+                = execute(EXEC_CALL_NO_IO, (char **)0, (char **)0);
+
+        switch (context->pid)
+        {
+            case -1:
+                cexit (11);
+            case 0:
+                break;
+            default:
+                cexit (0);
+        }
+    }
+
+    /* the probe workers need to be our children, not those of the process
+     * that just exited, or we'd never hear about them dying */
+    dev9_probe_initialise();
+
     fs = dfs_create ((void *)0, (void *)0);
     fs->root->c.mode |= 0111;
 
     struct dfs_directory *d_dev9 = dfs_mk_directory (fs->root, "dev9");
     struct dfs_file *d_dev9_ctl  = dfs_mk_file (d_dev9, "control", (char *)0,
             (int_8 *)"(nop)\n", 6, (void *)0, (void *)0, on_control_write);
+    struct dfs_file *d_dev9_events = dev9_events_initialise (d_dev9);
+    struct dfs_file *d_dev9_stats  = dev9_statistics_initialise (d_dev9);
+
+    dev9_query_initialise (d_dev9);
 
     queue_io = io_open_special();
     d_dev9->c.mode     = 0550;
@@ -339,11 +634,19 @@ int cmain() {
     d_dev9_ctl->c.mode = 0660;
     d_dev9_ctl->c.uid  = "dev9";
     d_dev9_ctl->c.gid  = "dev9";
+    d_dev9_events->c.mode = 0440;
+    d_dev9_events->c.uid  = "dev9";
+    d_dev9_events->c.gid  = "dev9";
+    d_dev9_stats->c.mode  = 0440;
+    d_dev9_stats->c.uid   = "dev9";
+    d_dev9_stats->c.gid   = "dev9";
 
     queue = sx_open_io (queue_io, queue_io);
 
     multiplex_add_sexpr (queue, mx_sx_ctl_queue_read, (void *)0);
 
+    /* before any device nodes: the root's listing picks up whatever is in
+     * the root when the first one goes in */
     if (initialise_common)
     {
         struct dfs_directory *d;
@@ -358,101 +661,42 @@ int cmain() {
         dfs_mk_symlink (fs->root, "stderr", "fd/2");
     }
 
+    /* the views first, so they get the placeholders */
+    dev9_views_initialise ();
+    dev9_autoload_initialise (fs);
+
     connect_to_netlink(fs);
 
     multiplex_all_processes();
 
     multiplex_d9s();
+    multiplex_network();
 
     if (use_stdio)
     {
-        multiplex_add_d9s_stdio (fs);
-    }
-    else if (o_foreground == 0)
-    {
-        struct exec_context *context
-                = execute(EXEC_CALL_NO_IO, (char **)0, (char **)0);
-
-        switch (context->pid)
-        {
-            case -1:
-                cexit (11);
-            case 0:
-                break;
-            default:
-                cexit (0);
-        }
+        dev9_transport_add_stdio (fs);
     }
 
     if (use_socket != (char *)0) {
-        multiplex_add_d9s_socket (use_socket, fs);
+        dev9_transport_add_socket (use_socket, fs);
     }
 
     if (mount_self)
     {
-        static char options[] =
-                "access=any,trans=fd,rfdno=000000,wfdno=000000";
-        struct io *in, *out;
-        int fdi[2], fdo[2];
+        mount_dfs (fs, "/dev", initialise_common);
+    }
 
-        if ((sys_pipe (fdi) != -1) && (sys_pipe (fdo) != -1))
+    for (view = dev9_views (); view != (struct dev9_view *)0;
+         view = view->next)
+    {
+        if (view->socket != (const char *)0)
         {
-            struct exec_context *context;
-            in  = io_open(fdi[0]);
-            out = io_open(fdo[1]);
-
-            multiplex_add_d9s_io(in, out, fs);
-
-            if (!((fdo[0] > 999999) || (fdi[1] > 999999) ||
-                  (fdo[0] < 1)      || (fdi[1] < 1)))
-            {
-                int tj, ti, mn, s2 = 44;
-
-                for (tj = 31, ti = fdo[0], mn = 6; ti > 0; tj--, ti /= 10, mn--)
-                {
-                    options[tj] = '0' + (ti % 10);
-                }
-
-                for (tj = 26, ti = tj + mn; options[ti]; tj++, ti++)
-                {
-                    options[tj] = options[ti];
-                }
-                options[tj] = options[ti];
-
-                s2 -= mn;
-
-                for (tj = s2, ti = fdi[1], mn = 6; ti > 0; tj--, ti /= 10, mn--)
-                {
-                    options[tj] = '0' + (ti % 10);
-                }
-
-                for (tj = s2-5, ti = tj + mn; options[ti]; tj++, ti++)
-                {
-                    options[tj] = options[ti];
-                }
-                options[tj] = options[ti];
+            dev9_transport_add_socket (view->socket, view->fs);
+        }
 
-                context = execute(EXEC_CALL_NO_IO, (char **)0, (char **)0);
-                switch (context->pid)
-                {
-                    case -1:
-                        cexit (30);
-                    case 0:
-                        sys_close (fdi[0]);
-                        sys_close (fdo[1]);
-                        sys_mount ("dev9",   "/dev",     "9p",     0, options);
-                        if (initialise_common)
-                        {
-                            sys_mount ("devpts", "/dev/pts", "devpts", 0, (void *)0);
-                            sys_mount ("shm",    "/dev/shm", "tmpfs",  0, (void *)0);
-                        }
-                        cexit (0);
-                    default:
-                        sys_close (fdo[0]);
-                        sys_close (fdi[1]);
-                        multiplex_add_process(context, mx_on_subprocess_death, (void *)0);
-                }
-            }
+        if (mount_self && (view->mountpoint != (const char *)0))
+        {
+            mount_dfs (view->fs, view->mountpoint, 0);
         }
     }
 
@@ -0,0 +1,946 @@
+/*
+ * This file is part of the kyuba.org Dev9 project.
+ * See the appropriate repository at http://git.kyuba.org/ for exact file
+ * modification records.
+*/
+
+/*
+ * Copyright (c) 2008-2014, Kyuba Project Members
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+
+#include <dev9/devices.h>
+#include <dev9/rules.h>
+#include <dev9/statistics.h>
+#include <curie/memory.h>
+#include <curie/tree.h>
+#include <sievert/immutable.h>
+
+static struct tree devices = TREE_INITIALISER;
+static struct dev9_index *table = (struct dev9_index *)0;
+
+/* the listing of every directory that device nodes were put in, served to
+ * 9p clients in place of duat's tree. The entries dev9 adds are only in the
+ * listing; they're put into duat's tree while a 9p walk goes through them
+ * and taken out again afterwards. Directories dev9 created itself are
+ * released once their listing is empty. */
+struct directory
+{
+    struct dev9_index *listing;
+    struct tree *materialised;
+    char created;
+};
+
+/* an entry that's in duat's tree for the walks going through it */
+struct materialised
+{
+    int_32 walks;
+};
+
+/* nodes that more than one entry refers to, or that 9p clients hold on
+ * to; a node without a record is in exactly one entry and isn't held */
+struct node_record
+{
+    int_32 links;
+    int_32 holds;
+};
+
+/* nodes nothing refers to anymore; duat can't free them, so they're handed
+ * out again for new entries */
+struct spare_nodes
+{
+    void **nodes;
+    int_32 count;
+    int_32 allocated;
+};
+
+static struct tree directories = TREE_INITIALISER;
+static struct tree node_records = TREE_INITIALISER;
+
+static struct spare_nodes spare_devices = { (void **)0, 0, 0 };
+static struct spare_nodes spare_directories = { (void **)0, 0, 0 };
+
+static struct dev9_device_usage usage = { 0, 0, 0, 0, 0, 0 };
+
+/* what duat gives a new node, for nodes that are handed out again */
+static struct dfs_node_common device_defaults;
+static struct dfs_node_common directory_defaults;
+
+static struct memory_pool directory_pool
+        = MEMORY_POOL_INITIALISER (sizeof (struct directory));
+static struct memory_pool materialised_pool
+        = MEMORY_POOL_INITIALISER (sizeof (struct materialised));
+static struct memory_pool record_pool
+        = MEMORY_POOL_INITIALISER (sizeof (struct node_record));
+
+static struct memory_pool pool
+        = MEMORY_POOL_INITIALISER (sizeof (struct dev9_device));
+
+struct dev9_index *dev9_device_table (void)
+{
+    if (table == (struct dev9_index *)0)
+    {
+        table = dev9_index_create ();
+
+        dev9_statistics_register ("device-nodes",  &(usage.nodes));
+        dev9_statistics_register ("directories",   &(usage.directories));
+        dev9_statistics_register ("entries",       &(usage.entries));
+        dev9_statistics_register ("entries-materialised",
+                                  &(usage.materialised));
+        dev9_statistics_register ("spare-nodes",   &(usage.spare));
+    }
+
+    return table;
+}
+
+void dev9_device_usage (struct dev9_device_usage *u)
+{
+    *u = usage;
+    u->devices = dev9_device_table ()->live;
+}
+
+static void push_spare (struct spare_nodes *s, void *node)
+{
+    if (s->count == s->allocated)
+    {
+        int_32 allocated = (s->allocated == 0) ? 16 : (s->allocated * 2);
+
+        s->nodes = (s->allocated == 0)
+            ? (void **)get_mem (sizeof (void *) * allocated)
+            : (void **)resize_mem (sizeof (void *) * s->allocated,
+                                   (void *)s->nodes,
+                                   sizeof (void *) * allocated);
+        s->allocated = allocated;
+    }
+
+    s->nodes[s->count] = node;
+    s->count++;
+    usage.spare++;
+}
+
+static void *pop_spare (struct spare_nodes *s)
+{
+    if (s->count == 0)
+    {
+        return (void *)0;
+    }
+
+    s->count--;
+    usage.spare--;
+
+    return s->nodes[s->count];
+}
+
+/* nothing refers to the node anymore */
+static void recycle (struct dfs_node_common *node)
+{
+    switch (node->type)
+    {
+        case dft_device:
+            usage.nodes--;
+            push_spare (&spare_devices, (void *)node);
+            break;
+        case dft_directory:
+            usage.directories--;
+            push_spare (&spare_directories, (void *)node);
+            break;
+        default:
+            break;
+    }
+}
+
+static struct node_record *get_record
+        (struct dfs_node_common *node, char create)
+{
+    struct tree_node *n = tree_get_node (&node_records, (int_pointer)node);
+    struct node_record *r;
+
+    if (n != (struct tree_node *)0)
+    {
+        return (struct node_record *)node_get_value (n);
+    }
+
+    if (!create)
+    {
+        return (struct node_record *)0;
+    }
+
+    r = (struct node_record *)get_pool_mem (&record_pool);
+    r->links = 1;
+    r->holds = 0;
+
+    tree_add_node_value (&node_records, (int_pointer)node, (void *)r);
+
+    return r;
+}
+
+/* drop the record once it says no more than the lack of one would */
+static void settle_record (struct dfs_node_common *node, struct node_record *r)
+{
+    if (r->holds > 0)
+    {
+        return;
+    }
+
+    if (r->links <= 1)
+    {
+        tree_remove_node (&node_records, (int_pointer)node);
+        free_pool_mem ((void *)r);
+    }
+
+    if (r->links == 0)
+    {
+        recycle (node);
+    }
+}
+
+/* another entry refers to the node */
+static void link_node (struct dfs_node_common *node)
+{
+    get_record (node, 1)->links++;
+}
+
+/* an entry that referred to the node is gone */
+static void unlink_node (struct dfs_node_common *node)
+{
+    struct node_record *r = get_record (node, 0);
+
+    if (r == (struct node_record *)0)
+    {
+        recycle (node);
+        return;
+    }
+
+    r->links--;
+    settle_record (node, r);
+}
+
+void dev9_node_hold (struct dfs_node_common *node)
+{
+    get_record (node, 1)->holds++;
+}
+
+void dev9_node_release (struct dfs_node_common *node)
+{
+    struct node_record *r = get_record (node, 0);
+
+    if (r != (struct node_record *)0)
+    {
+        r->holds--;
+        settle_record (node, r);
+    }
+}
+
+static struct directory *find_directory (struct dfs_directory *dir)
+{
+    struct tree_node *n = tree_get_node (&directories, (int_pointer)dir);
+
+    if (n == (struct tree_node *)0)
+    {
+        return (struct directory *)0;
+    }
+
+    return (struct directory *)node_get_value (n);
+}
+
+struct dev9_index *dev9_directory_listing (struct dfs_directory *dir)
+{
+    struct directory *d = find_directory (dir);
+
+    return (d == (struct directory *)0) ? (struct dev9_index *)0
+                                        : d->listing;
+}
+
+static void adopt_entry (struct tree_node *n, void *listing)
+{
+    struct dfs_node_common *c = (struct dfs_node_common *)node_get_value (n);
+
+    dev9_index_add_named ((struct dev9_index *)listing,
+                          str_immutable (c->name), (void *)c);
+}
+
+static struct directory *track_directory
+        (struct dfs_directory *dir, char created)
+{
+    struct directory *d = (struct directory *)get_pool_mem (&directory_pool);
+
+    d->listing      = dev9_index_create ();
+    d->materialised = (struct tree *)0;
+    d->created      = created;
+
+    /* whatever was there before the first device node, like the root's
+     * dev9/ and the common nodes, has to show up in the listing as well;
+     * those entries stay in duat's tree */
+    if (!created)
+    {
+        tree_map (dir->nodes, adopt_entry, (void *)d->listing);
+    }
+
+    tree_add_node_value (&directories, (int_pointer)dir, (void *)d);
+
+    return d;
+}
+
+static struct directory *directory_of (struct dfs_directory *dir)
+{
+    struct directory *d = find_directory (dir);
+
+    return (d == (struct directory *)0) ? track_directory (dir, 0) : d;
+}
+
+static struct materialised *find_materialised
+        (struct directory *d, const char *name)
+{
+    struct tree_node *n;
+
+    if (d->materialised == (struct tree *)0)
+    {
+        return (struct materialised *)0;
+    }
+
+    n = tree_get_node_string (d->materialised, (char *)name);
+
+    if (n == (struct tree_node *)0)
+    {
+        return (struct materialised *)0;
+    }
+
+    return (struct materialised *)node_get_value (n);
+}
+
+/* add an entry to the listing, and to duat's tree if a walk is waiting to
+ * go through it */
+static void list_entry
+        (struct dfs_directory *dir, struct directory *d, const char *name,
+         struct dfs_node_common *node)
+{
+    const char *iname = str_immutable (name);
+
+    dev9_index_add_named (d->listing, iname, (void *)node);
+    usage.entries++;
+
+    if (find_materialised (d, iname) != (struct materialised *)0)
+    {
+        tree_add_node_string_value (dir->nodes, (char *)iname, (void *)node);
+    }
+}
+
+static void unlist_entry
+        (struct dfs_directory *dir, const char *name,
+         struct dfs_node_common *node)
+{
+    struct directory *d = find_directory (dir);
+
+    if (d != (struct directory *)0)
+    {
+        dev9_index_remove_named (d->listing, name);
+        usage.entries--;
+    }
+
+    tree_remove_node_string (dir->nodes, (char *)name);
+    unlink_node (node);
+}
+
+static void drop_materialised (struct tree_node *n, void *aux)
+{
+    free_pool_mem (node_get_value (n));
+    usage.materialised--;
+}
+
+static char directory_released (struct dfs_directory *dir)
+{
+    struct directory *d = find_directory (dir);
+
+    if ((d == (struct directory *)0) || !d->created || (d->listing->live > 0))
+    {
+        return 0;
+    }
+
+    tree_remove_node (&directories, (int_pointer)dir);
+    dev9_index_destroy (d->listing);
+
+    /* walks that are still going through it just let go of the directory
+     * when they're done */
+    if (d->materialised != (struct tree *)0)
+    {
+        tree_map (d->materialised, drop_materialised, (void *)0);
+        tree_destroy (d->materialised);
+    }
+
+    free_pool_mem ((void *)d);
+
+    return 1;
+}
+
+struct dfs_node_common *dev9_directory_lookup
+        (struct dfs_directory *dir, const char *name)
+{
+    struct directory *d = find_directory (dir);
+    struct tree_node *n;
+
+    if (d != (struct directory *)0)
+    {
+        return (struct dfs_node_common *)dev9_index_lookup (d->listing, name);
+    }
+
+    n = tree_get_node_string (dir->nodes, (char *)name);
+
+    if (n == (struct tree_node *)0)
+    {
+        return (struct dfs_node_common *)0;
+    }
+
+    return (struct dfs_node_common *)node_get_value (n);
+}
+
+const char *dev9_directory_materialise
+        (struct dfs_directory *dir, const char *name)
+{
+    struct directory *d = find_directory (dir);
+    struct materialised *m;
+    const char *iname;
+    void *node;
+
+    if ((d == (struct directory *)0) ||
+        ((node = dev9_index_lookup (d->listing, name)) == (void *)0))
+    {
+        return (const char *)0;
+    }
+
+    iname = str_immutable (name);
+    m = find_materialised (d, iname);
+
+    if (m == (struct materialised *)0)
+    {
+        /* one of the entries that were there before dev9 took over */
+        if (tree_get_node_string (dir->nodes, (char *)iname)
+                != (struct tree_node *)0)
+        {
+            return (const char *)0;
+        }
+
+        if (d->materialised == (struct tree *)0)
+        {
+            d->materialised = tree_create ();
+        }
+
+        m = (struct materialised *)get_pool_mem (&materialised_pool);
+        m->walks = 0;
+
+        tree_add_node_string_value (d->materialised, (char *)iname,
+                                    (void *)m);
+        tree_add_node_string_value (dir->nodes, (char *)iname, node);
+        usage.materialised++;
+    }
+
+    m->walks++;
+    dev9_node_hold (&(dir->c));
+
+    return iname;
+}
+
+void dev9_directory_dematerialise (struct dfs_directory *dir, const char *name)
+{
+    struct directory *d = find_directory (dir);
+    struct materialised *m = (d == (struct directory *)0)
+                           ? (struct materialised *)0
+                           : find_materialised (d, name);
+
+    if (m != (struct materialised *)0)
+    {
+        m->walks--;
+
+        if (m->walks == 0)
+        {
+            tree_remove_node_string (d->materialised, (char *)name);
+            tree_remove_node_string (dir->nodes, (char *)name);
+            free_pool_mem ((void *)m);
+            usage.materialised--;
+        }
+    }
+
+    dev9_node_release (&(dir->c));
+}
+
+struct dfs_device *dev9_mk_device
+        (struct dfs_directory *dir, const char *name, char block_device,
+         int_16 majour, int_16 minor)
+{
+    struct directory *d = directory_of (dir);
+    struct dfs_device *node = (struct dfs_device *)pop_spare (&spare_devices);
+
+    if (node == (struct dfs_device *)0)
+    {
+        node = dfs_mk_device (dir, name,
+                              block_device ? dfs_block_device
+                                           : dfs_character_device,
+                              majour, minor);
+
+        /* the entry goes into the listing, not into duat's tree */
+        tree_remove_node_string (dir->nodes, (char *)name);
+        device_defaults = node->c;
+    }
+    else
+    {
+        node->c.name  = (char *)str_immutable (name);
+        node->c.mode  = device_defaults.mode;
+        node->c.uid   = device_defaults.uid;
+        node->c.gid   = device_defaults.gid;
+        node->c.muid  = device_defaults.muid;
+        node->c.atime = device_defaults.atime;
+        node->c.mtime = device_defaults.mtime;
+        node->type    = block_device ? dfs_block_device
+                                     : dfs_character_device;
+        node->majour  = majour;
+        node->minor   = minor;
+    }
+
+    usage.nodes++;
+    list_entry (dir, d, name, &(node->c));
+
+    return node;
+}
+
+struct dfs_directory *dev9_mk_directory
+        (struct dfs_directory *dir, const char *name)
+{
+    struct directory *d = directory_of (dir);
+    struct dfs_directory *node
+            = (struct dfs_directory *)pop_spare (&spare_directories);
+
+    if (node == (struct dfs_directory *)0)
+    {
+        node = dfs_mk_directory (dir, name);
+
+        tree_remove_node_string (dir->nodes, (char *)name);
+        directory_defaults = node->c;
+    }
+    else
+    {
+        node->c.name  = (char *)str_immutable (name);
+        node->c.mode  = directory_defaults.mode;
+        node->c.uid   = directory_defaults.uid;
+        node->c.gid   = directory_defaults.gid;
+        node->c.muid  = directory_defaults.muid;
+        node->c.atime = directory_defaults.atime;
+        node->c.mtime = directory_defaults.mtime;
+        node->parent  = dir;
+    }
+
+    node->c.mode |= 0111;
+
+    usage.directories++;
+    list_entry (dir, d, name, &(node->c));
+    (void)track_directory (node, 1);
+
+    return node;
+}
+
+struct dfs_device *dev9_mk_alias
+        (struct dfs_directory *dir, const char *name, struct dfs_device *node,
+         char block_device, int_16 majour, int_16 minor)
+{
+    struct dfs_device *d
+            = (struct dfs_device *)dev9_directory_lookup (dir, name);
+
+    if (d != (struct dfs_device *)0)
+    {
+        if (d->c.type != dft_device)
+        {
+            return (struct dfs_device *)0;
+        }
+
+        if ((d == node) || ((d->majour == majour) && (d->minor == minor)))
+        {
+            d->type = block_device ? dfs_block_device : dfs_character_device;
+            return d;
+        }
+
+        /* another device's node; the name belongs to this one now */
+        unlist_entry (dir, name, &(d->c));
+    }
+
+    /* the entry's name is what listings show, so the alias doesn't need
+     * the node's base name */
+    if (node != (struct dfs_device *)0)
+    {
+        link_node (&(node->c));
+        list_entry (dir, directory_of (dir), name, &(node->c));
+
+        return node;
+    }
+
+    return dev9_mk_device (dir, name, block_device, majour, minor);
+}
+
+struct dev9_device *dev9_device_find (const char *devpath)
+{
+    struct tree_node *n = tree_get_node_string (&devices, (char *)devpath);
+
+    if (n == (struct tree_node *)0)
+    {
+        return (struct dev9_device *)0;
+    }
+
+    return (struct dev9_device *)node_get_value (n);
+}
+
+struct dev9_device *dev9_device_get (const char *devpath)
+{
+    struct dev9_device *d = dev9_device_find (devpath);
+
+    if (d != (struct dev9_device *)0)
+    {
+        return d;
+    }
+
+    d = (struct dev9_device *)get_pool_mem (&pool);
+
+    d->devpath      = str_immutable (devpath);
+    d->subsystem    = (const char *)0;
+    d->user         = "root";
+    d->group        = "root";
+    d->mode         = 0;
+    d->majour       = 0;
+    d->minor        = 0;
+    d->block_device = 0;
+    d->names         = (char *)0;
+    d->names_length  = 0;
+    d->probed        = (char *)0;
+    d->probed_length = 0;
+
+    tree_add_node_string_value (&devices, (char *)d->devpath, (void *)d);
+    dev9_index_add (dev9_device_table (), (void *)d);
+
+    return d;
+}
+
+char dev9_device_unlink
+        (struct dfs *fs, const char *path, int_16 majour, int_16 minor)
+{
+    char buf[DEV9_PATH_MAX];
+    char *components[DEV9_PATH_DEPTH];
+    struct dfs_directory *dirs[DEV9_PATH_DEPTH];
+    struct dfs_device *d;
+    int depth = 0, i;
+
+    for (i = 0; (path[i] != (char)0) && (i < (DEV9_PATH_MAX - 1)); i++)
+    {
+        buf[i] = path[i];
+    }
+    buf[i] = (char)0;
+
+    for (i = 0; buf[i] != (char)0; )
+    {
+        if (depth == DEV9_PATH_DEPTH) return 0;
+
+        components[depth] = buf + i;
+        depth++;
+
+        while ((buf[i] != (char)0) && (buf[i] != '/')) i++;
+        if (buf[i] == '/') { buf[i] = (char)0; i++; }
+    }
+
+    if (depth == 0) return 0;
+
+    dirs[0] = fs->root;
+
+    for (i = 0; i < (depth - 1); i++)
+    {
+        struct dfs_node_common *c
+                = dev9_directory_lookup (dirs[i], components[i]);
+
+        if ((c == (struct dfs_node_common *)0) || (c->type != dft_directory))
+        {
+            return 0;
+        }
+
+        dirs[i+1] = (struct dfs_directory *)c;
+    }
+
+    d = (struct dfs_device *)dev9_directory_lookup
+            (dirs[depth-1], components[depth-1]);
+
+    if (d == (struct dfs_device *)0) return 0;
+
+    /* someone else's node by now, leave it be */
+    if ((d->c.type != dft_device) ||
+        (d->majour != majour) || (d->minor != minor))
+    {
+        return 0;
+    }
+
+    unlist_entry (dirs[depth-1], components[depth-1], &(d->c));
+
+    /* release directories that were created for nodes, once they're empty */
+    for (i = depth - 1; (i > 0) && directory_released (dirs[i]); i--)
+    {
+        unlist_entry (dirs[i-1], components[i-1], &(dirs[i]->c));
+    }
+
+    return 1;
+}
+
+static struct dfs_device *make_node
+        (struct dfs *fs, const char *path, char block_device,
+         int_16 majour, int_16 minor, char update)
+{
+    struct dfs_directory *dir = fs->root;
+    char buf[DEV9_PATH_MAX];
+    const char *s = path;
+
+    while (*s != (char)0)
+    {
+        struct dfs_node_common *n;
+        int i = 0;
+
+        while ((*s != (char)0) && (*s != '/') && (i < (DEV9_PATH_MAX - 1)))
+        {
+            buf[i] = *s; i++; s++;
+        }
+        buf[i] = (char)0;
+
+        if (*s == '/') s++;
+        if (i == 0) continue;
+
+        n = dev9_directory_lookup (dir, buf);
+
+        if (*s == (char)0)
+        {
+            if (update)
+            {
+                return dev9_mk_alias (dir, buf, (struct dfs_device *)0,
+                                      block_device, majour, minor);
+            }
+
+            if (n != (struct dfs_node_common *)0) return (struct dfs_device *)0;
+
+            return dev9_mk_device (dir, buf, block_device, majour, minor);
+        }
+        else if (n == (struct dfs_node_common *)0)
+        {
+            dir = dev9_mk_directory (dir, buf);
+        }
+        else
+        {
+            if (n->type != dft_directory) return (struct dfs_device *)0;
+
+            dir = (struct dfs_directory *)n;
+        }
+    }
+
+    return (struct dfs_device *)0;
+}
+
+struct dfs_device *dev9_device_mknod
+        (struct dfs *fs, const char *path, char block_device,
+         int_16 majour, int_16 minor)
+{
+    return make_node (fs, path, block_device, majour, minor, 0);
+}
+
+struct dfs_device *dev9_device_mknod_update
+        (struct dfs *fs, const char *path, char block_device,
+         int_16 majour, int_16 minor)
+{
+    return make_node (fs, path, block_device, majour, minor, 1);
+}
+
+static char has_name (sexpr names, const char *name)
+{
+    for (; consp(names); names = cdr (names))
+    {
+        sexpr n = car (names);
+
+        if (stringp(n) && dev9_streq (sx_string (n), name)) return 1;
+    }
+
+    return 0;
+}
+
+/* unlink the packed names that aren't in the new list, and pack the new
+ * list in their place */
+static sexpr replace_names
+        (struct dev9_device *d, struct dfs *fs, char **packed,
+         int_32 *packed_length, sexpr names)
+{
+    sexpr released = sx_end_of_list, cur;
+    int_32 i, length = 1;
+    char *p;
+
+    for (i = 0; i < *packed_length; )
+    {
+        const char *name = (*packed) + i;
+        int_32 l = 0;
+
+        while (name[l] != (char)0) l++;
+
+        if ((l > 0) && !has_name (names, name) &&
+            dev9_device_unlink (fs, name, d->majour, d->minor))
+        {
+            released = cons (make_string (name), released);
+        }
+
+        i += l + 1;
+    }
+
+    if (*packed != (char *)0)
+    {
+        free_mem (*packed_length, (void *)*packed);
+        *packed        = (char *)0;
+        *packed_length = 0;
+    }
+
+    for (cur = names; consp(cur); cur = cdr (cur))
+    {
+        sexpr n = car (cur);
+
+        if (stringp(n))
+        {
+            for (i = 0; sx_string (n)[i] != (char)0; i++);
+            length += i + 1;
+        }
+    }
+
+    if (length == 1)
+    {
+        return released;
+    }
+
+    *packed        = (char *)get_mem (length);
+    *packed_length = length;
+
+    for (cur = names, p = *packed; consp(cur); cur = cdr (cur))
+    {
+        sexpr n = car (cur);
+
+        if (stringp(n))
+        {
+            const char *s = sx_string (n);
+
+            while (*s != (char)0) { *p = *s; p++; s++; }
+
+            *p = (char)0;
+            p++;
+        }
+    }
+
+    *p = (char)0;
+
+    return released;
+}
+
+sexpr dev9_device_set_names (struct dev9_device *d, struct dfs *fs, sexpr names)
+{
+    /* release whatever the rules didn't produce this time around */
+    return replace_names (d, fs, &(d->names), &(d->names_length), names);
+}
+
+static char has_packed_name
+        (const char *packed, int_32 length, const char *path)
+{
+    int_32 i = 0;
+
+    while (i < length)
+    {
+        const char *name = packed + i;
+        int_32 l = 0;
+
+        while (name[l] != (char)0) l++;
+
+        if ((l > 0) && dev9_streq (name, path)) return 1;
+
+        i += l + 1;
+    }
+
+    return 0;
+}
+
+sexpr dev9_device_set_probed_names
+        (struct dev9_device *d, struct dfs *fs, sexpr paths)
+{
+    sexpr keep = sx_end_of_list;
+
+    for (; consp(paths); paths = cdr (paths))
+    {
+        sexpr path = car (paths);
+        struct dfs_device *node;
+
+        if (!stringp(path)) continue;
+
+        if (has_packed_name (d->probed, d->probed_length, sx_string (path)))
+        {
+            keep = cons (path, keep);
+            continue;
+        }
+
+        node = dev9_device_mknod (fs, sx_string (path), d->block_device,
+                                  d->majour, d->minor);
+
+        /* the name is taken, and not by us */
+        if (node == (struct dfs_device *)0) continue;
+
+        node->c.uid  = (char *)d->user;
+        node->c.muid = (char *)d->user;
+        node->c.gid  = (char *)d->group;
+        node->c.mode = (node->c.mode & ~07777) | d->mode;
+
+        keep = cons (path, keep);
+    }
+
+    return replace_names (d, fs, &(d->probed), &(d->probed_length), keep);
+}
+
+const char *dev9_device_next_name (struct dev9_device *d, int_32 *cursor)
+{
+    while (*cursor < (d->names_length + d->probed_length))
+    {
+        const char *name = (*cursor < d->names_length)
+                         ? (d->names + *cursor)
+                         : (d->probed + (*cursor - d->names_length));
+        int_32 l = 0;
+
+        while (name[l] != (char)0) l++;
+
+        *cursor += l + 1;
+
+        if (l > 0) return name;
+    }
+
+    return (const char *)0;
+}
+
+sexpr dev9_device_drop (struct dev9_device *d, struct dfs *fs)
+{
+    sexpr released = dev9_device_set_names (d, fs, sx_end_of_list);
+    sexpr probed   = dev9_device_set_probed_names (d, fs, sx_end_of_list);
+
+    for (; consp(probed); probed = cdr (probed))
+    {
+        released = cons (car (probed), released);
+    }
+
+    tree_remove_node_string (&devices, (char *)d->devpath);
+    dev9_index_remove (dev9_device_table (), (void *)d);
+    free_pool_mem ((void *)d);
+
+    return released;
+}
@@ -0,0 +1,286 @@
+/*
+ * This file is part of the kyuba.org Dev9 project.
+ * See the appropriate repository at http://git.kyuba.org/ for exact file
+ * modification records.
+*/
+
+/*
+ * Copyright (c) 2008-2014, Kyuba Project Members
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+
+#include <dev9/events.h>
+#include <dev9/rules.h>
+#include <curie/memory.h>
+#include <curie/io.h>
+
+/* All subscribers share a single byte ring; the stream offset that the 9p
+ * client sends with each read doubles as that reader's cursor, so there's no
+ * per-subscriber state or copy of the event data. Readers that fall behind by
+ * more than the ring holds get whitespace for the lost part of the stream,
+ * followed by an overflow marker right before the oldest retained record.
+ *
+ * Records are padded to a multiple of RECORD_ALIGN bytes, and reads only
+ * ever stop on such a multiple, so a reader that fell behind is always at
+ * least RECORD_ALIGN bytes short of the oldest record, which leaves room for
+ * the marker even if it was in the middle of a record that got dropped. */
+
+#define OVERFLOW_MARKER "\n(overflow)\n"
+#define MARKER_LENGTH   ((int_32)(sizeof (OVERFLOW_MARKER) - 1))
+#define RECORD_ALIGN    16
+
+static int_8 ring[DEV9_EVENTS_BUFFER];
+
+static struct record {
+    int_64 offset;
+    int_32 length;
+} records[DEV9_EVENTS_RECORDS];
+
+static unsigned int first = 0;
+static unsigned int count = 0;
+static int_64 head = 0;
+
+static struct dfs_file *events_file = (struct dfs_file *)0;
+static struct io *events_io = (struct io *)0;
+static struct sexpr_io *events_sx = (struct sexpr_io *)0;
+
+define_symbol (sym_action,   "ACTION");
+define_symbol (sym_seqnum,   "SEQNUM");
+define_symbol (sym_majour,   "MAJOR");
+define_symbol (sym_minor,    "MINOR");
+define_symbol (sym_nodes,    "nodes");
+define_symbol (sym_change,   "change");
+define_symbol (sym_seqnum_l, "seqnum");
+define_symbol (sym_majour_l, "major");
+define_symbol (sym_minor_l,  "minor");
+
+static struct record *get_record (unsigned int i)
+{
+    return &(records[(first + i) % DEV9_EVENTS_RECORDS]);
+}
+
+static void push_record (const int_8 *data, int_32 size)
+{
+    struct record *r;
+    int_32 i, length = size;
+
+    if (length % RECORD_ALIGN)
+    {
+        length += RECORD_ALIGN - (length % RECORD_ALIGN);
+    }
+
+    if ((size <= 0) || (length > DEV9_EVENTS_BUFFER))
+    {
+        return;
+    }
+
+    /* drop the oldest records until the new one fits */
+    while ((count > 0) &&
+           ((count == DEV9_EVENTS_RECORDS) ||
+            ((head + length - get_record (0)->offset) > DEV9_EVENTS_BUFFER)))
+    {
+        first = (first + 1) % DEV9_EVENTS_RECORDS;
+        count--;
+    }
+
+    r = get_record (count);
+    r->offset = head;
+    r->length = length;
+    count++;
+
+    /* pad with blanks, before the record's final newline */
+    if (data[size - 1] == '\n')
+    {
+        size--;
+    }
+
+    for (i = 0; i < length; i++)
+    {
+        ring[(head + i) % DEV9_EVENTS_BUFFER] = (i < size)         ? data[i]
+                                              : (i < (length - 1)) ? ' '
+                                              : '\n';
+    }
+
+    head += length;
+
+    if (events_file != (struct dfs_file *)0)
+    {
+        events_file->length = head;
+    }
+}
+
+static int_32 read_gap (int_64 offset, int_64 tail, int_32 length, int_8 *data)
+{
+    int_64 gap = tail - offset;
+    int_64 marker = tail - MARKER_LENGTH;
+    int_32 n, i;
+
+    if (gap <= length)
+    {
+        n = (int_32)gap;
+    }
+    else
+    {
+        /* only blanks for now; the marker comes in one piece at the end */
+        n = length - (length % RECORD_ALIGN);
+
+        if (n == 0)
+        {
+            n = length;
+        }
+
+        if ((offset + n) > marker)
+        {
+            n = (marker > offset) ? (int_32)(marker - offset) : length;
+        }
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        int_64 p = offset + i;
+
+        /* a reader that isn't on the RECORD_ALIGN grid may be too close to
+         * fit the marker; it only gets blanks */
+        data[i] = ((p >= marker) && (gap >= MARKER_LENGTH))
+                ? OVERFLOW_MARKER[p - marker]
+                : ' ';
+    }
+
+    return n;
+}
+
+static int_32 on_events_read
+        (struct dfs_file *f, int_64 offset, int_32 length, int_8 *data)
+{
+    int_64 tail = (count > 0) ? get_record (0)->offset : head;
+    int_64 end;
+    unsigned int lo = 0, hi = count;
+    int_32 n, i;
+
+    if ((offset >= head) || (length <= 0))
+    {
+        return 0;
+    }
+
+    if (offset < tail)
+    {
+        return read_gap (offset, tail, length, data);
+    }
+
+    /* find the record containing the offset */
+    while ((hi - lo) > 1)
+    {
+        unsigned int mid = lo + ((hi - lo) / 2);
+
+        if (get_record (mid)->offset <= offset)
+        {
+            lo = mid;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    /* hand out whole records only, unless the first one doesn't fit; then
+     * stay on the RECORD_ALIGN grid if the reader's buffer allows it */
+    end = get_record (lo)->offset + get_record (lo)->length;
+    if ((end - offset) > length)
+    {
+        end = offset + length;
+
+        if (length >= RECORD_ALIGN)
+        {
+            end -= length % RECORD_ALIGN;
+        }
+    }
+    else
+    {
+        for (lo++; lo < count; lo++)
+        {
+            struct record *r = get_record (lo);
+
+            if ((r->offset + r->length - offset) > length) break;
+
+            end = r->offset + r->length;
+        }
+    }
+
+    n = (int_32)(end - offset);
+
+    for (i = 0; i < n; i++)
+    {
+        data[i] = ring[(offset + i) % DEV9_EVENTS_BUFFER];
+    }
+
+    return n;
+}
+
+struct dfs_file *dev9_events_initialise (struct dfs_directory *dir)
+{
+    events_io = io_open_special ();
+    events_sx = sx_open_io (io_open (-1), events_io);
+
+    events_file = dfs_mk_file (dir, "events", (char *)0, (int_8 *)0, 0,
+                               (void *)0, on_events_read, (void *)0);
+
+    events_file->length = head;
+
+    return events_file;
+}
+
+void dev9_events_record (sexpr attributes, sexpr nodes)
+{
+    sexpr action = dev9_lookup_symbol (attributes, sym_action);
+    sexpr t, record = sx_end_of_list;
+
+    if ((events_sx == (struct sexpr_io *)0) || !consp(nodes))
+    {
+        return;
+    }
+
+    record = cons (cons (sym_nodes, nodes), record);
+
+    if (stringp(t = dev9_lookup_symbol (attributes, sym_minor)))
+    {
+        record = cons (cons (sym_minor_l, t), record);
+    }
+    if (stringp(t = dev9_lookup_symbol (attributes, sym_majour)))
+    {
+        record = cons (cons (sym_majour_l, t), record);
+    }
+    if (stringp(t = dev9_lookup_symbol (attributes, sym_seqnum)))
+    {
+        record = cons (cons (sym_seqnum_l, t), record);
+    }
+
+    record = cons (stringp(action) ? make_symbol (sx_string (action))
+                                   : sym_change,
+                   record);
+
+    sx_write (events_sx, record);
+
+    push_record ((int_8 *)events_io->buffer + events_io->position,
+                 (int_32)(events_io->length - events_io->position));
+
+    events_io->position = 0;
+    events_io->length   = 0;
+}
@@ -0,0 +1,134 @@
+/*
+ * This file is part of the kyuba.org Dev9 project.
+ * See the appropriate repository at http://git.kyuba.org/ for exact file
+ * modification records.
+*/
+
+/*
+ * Copyright (c) 2008-2014, Kyuba Project Members
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+
+/* Prints what the identity probe would find on the given devices or image
+ * files, one S-expression per file, e.g.
+ *   (identity "disk.img" (ptuuid . "5b1f3c2a"))
+ *   (identity "part.img" (uuid . "0c6e...") (label . "root"))
+ * A "-p N" before a file also reads the PARTUUID of the file's partition N,
+ * which is how the probe reads it off a partition's disk. */
+
+#include <dev9/signatures.h>
+#include <curie/main.h>
+#include <curie/sexpr.h>
+#include <curie/multiplex.h>
+
+#include <syscall/syscall.h>
+
+#include <asm/fcntl.h>
+
+define_symbol (sym_identity, "identity");
+define_symbol (sym_uuid,     "uuid");
+define_symbol (sym_label,    "label");
+define_symbol (sym_ptuuid,   "ptuuid");
+define_symbol (sym_partuuid, "partuuid");
+define_symbol (sym_error,    "error");
+
+static void print_identity
+        (struct sexpr_io *out, const char *file, int partition)
+{
+    struct dev9_identity identity;
+    sexpr reply = sx_end_of_list;
+    int fd = sys_open (file, O_RDONLY, 0);
+
+    if (fd < 0)
+    {
+        sx_write (out, cons (sym_error, cons (make_string (file),
+                                              sx_end_of_list)));
+        return;
+    }
+
+    dev9_identity_clear (&identity);
+    dev9_probe_identify (fd, &identity);
+
+    if (partition > 0)
+    {
+        dev9_probe_partition (fd, partition, &identity);
+    }
+
+    sys_close (fd);
+
+    if (identity.partuuid[0] != (char)0)
+    {
+        reply = cons (cons (sym_partuuid, make_string (identity.partuuid)),
+                      reply);
+    }
+    if (identity.ptuuid[0] != (char)0)
+    {
+        reply = cons (cons (sym_ptuuid, make_string (identity.ptuuid)), reply);
+    }
+    if (identity.label[0] != (char)0)
+    {
+        reply = cons (cons (sym_label, make_string (identity.label)), reply);
+    }
+    if (identity.uuid[0] != (char)0)
+    {
+        reply = cons (cons (sym_uuid, make_string (identity.uuid)), reply);
+    }
+
+    sx_write (out, cons (sym_identity, cons (make_string (file), reply)));
+}
+
+int cmain ()
+{
+    struct sexpr_io *out;
+    int partition = 0;
+    unsigned int i;
+
+    multiplex_io ();
+    multiplex_sexpr ();
+
+    out = sx_open_io (io_open (-1), io_open (1));
+
+    for (i = 1; curie_argv[i]; i++)
+    {
+        if ((curie_argv[i][0] == '-') && (curie_argv[i][1] == 'p') &&
+            (curie_argv[i][2] == (char)0))
+        {
+            const char *n = curie_argv[i + 1];
+
+            if (n == (const char *)0) break;
+
+            for (partition = 0; (*n >= '0') && (*n <= '9'); n++)
+            {
+                partition = (partition * 10) + (*n - '0');
+            }
+
+            i++;
+            continue;
+        }
+
+        print_identity (out, curie_argv[i], partition);
+        partition = 0;
+    }
+
+    sx_close_io (out);
+
+    return 0;
+}
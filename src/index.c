@@ -0,0 +1,399 @@
+/*
+ * This file is part of the kyuba.org Dev9 project.
+ * See the appropriate repository at http://git.kyuba.org/ for exact file
+ * modification records.
+*/
+
+/*
+ * Copyright (c) 2008-2014, Kyuba Project Members
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+
+#include <dev9/index.h>
+#include <curie/memory.h>
+#include <curie/tree.h>
+
+#define INDEX_INITIAL_ENTRIES 16
+
+/* the tree node that maps an entry's key to the entry */
+static struct tree_node *find_key
+        (struct dev9_index *idx, const char *name, void *node)
+{
+    return (name != (const char *)0)
+        ? tree_get_node_string (&(idx->nodes), (char *)name)
+        : tree_get_node (&(idx->nodes), (int_pointer)node);
+}
+
+static void remove_key (struct dev9_index *idx, const char *name, void *node)
+{
+    if (name != (const char *)0)
+    {
+        tree_remove_node_string (&(idx->nodes), (char *)name);
+    }
+    else
+    {
+        tree_remove_node (&(idx->nodes), (int_pointer)node);
+    }
+}
+
+static void set_entry
+        (struct dev9_index *idx, struct dev9_index_entry *e, int_32 entry)
+{
+    if (e->name != (const char *)0)
+    {
+        tree_add_node_string_value (&(idx->nodes), (char *)e->name,
+                                    (void *)(int_pointer)(entry + 1));
+    }
+    else
+    {
+        tree_add_node_value (&(idx->nodes), (int_pointer)e->node,
+                             (void *)(int_pointer)(entry + 1));
+    }
+}
+
+struct dev9_index *dev9_index_create (void)
+{
+    static struct memory_pool pool
+            = MEMORY_POOL_INITIALISER (sizeof (struct dev9_index));
+    struct dev9_index *idx = (struct dev9_index *)get_pool_mem (&pool);
+
+    idx->allocated  = INDEX_INITIAL_ENTRIES;
+    idx->entries    = (struct dev9_index_entry *)get_mem
+            (sizeof (struct dev9_index_entry) * INDEX_INITIAL_ENTRIES);
+    idx->used       = 0;
+    idx->live       = 0;
+    idx->generation = 0;
+    idx->nodes      = (struct tree)TREE_INITIALISER;
+
+    return idx;
+}
+
+void dev9_index_destroy (struct dev9_index *idx)
+{
+    int_32 i;
+
+    for (i = 0; i < idx->used; i++)
+    {
+        struct dev9_index_entry *e = &(idx->entries[i]);
+
+        if (e->node != (void *)0)
+        {
+            remove_key (idx, e->name, e->node);
+        }
+    }
+
+    free_mem (sizeof (struct dev9_index_entry) * idx->allocated,
+              (void *)idx->entries);
+    free_pool_mem ((void *)idx);
+}
+
+void dev9_index_reader_initialise (struct dev9_index_reader *reader)
+{
+    unsigned int i;
+
+    for (i = 0; i < DEV9_INDEX_CURSORS; i++)
+    {
+        reader->cursor[i].offset     = -1;
+        reader->cursor[i].entry      = 0;
+        reader->cursor[i].generation = -1;
+        reader->cursor[i].skip       = 0;
+        reader->cursor[i].next_name  = (const char *)0;
+        reader->cursor[i].next       = (void *)0;
+    }
+
+    reader->next_cursor = 0;
+}
+
+/* Squeeze out removed entries. Open cursors find their place again through
+ * the node they stopped at. */
+static void compact (struct dev9_index *idx)
+{
+    int_32 i, j = 0;
+
+    for (i = 0; i < idx->used; i++)
+    {
+        struct dev9_index_entry *e = &(idx->entries[i]);
+
+        if (e->node == (void *)0) continue;
+
+        if (i != j)
+        {
+            idx->entries[j] = *e;
+            remove_key (idx, e->name, e->node);
+            set_entry (idx, &(idx->entries[j]), j);
+        }
+
+        j++;
+    }
+
+    idx->used = j;
+    idx->generation++;
+}
+
+static void add_entry (struct dev9_index *idx, const char *name, void *node)
+{
+    struct dev9_index_entry *e;
+
+    if (find_key (idx, name, node) != (struct tree_node *)0)
+    {
+        return;
+    }
+
+    if (idx->used == idx->allocated)
+    {
+        idx->entries = (struct dev9_index_entry *)resize_mem
+                (sizeof (struct dev9_index_entry) * idx->allocated,
+                 (void *)idx->entries,
+                 sizeof (struct dev9_index_entry) * idx->allocated * 2);
+        idx->allocated *= 2;
+    }
+
+    e = &(idx->entries[idx->used]);
+
+    e->name = name;
+    e->node = node;
+
+    set_entry (idx, e, idx->used);
+
+    idx->used++;
+    idx->live++;
+}
+
+static void remove_entry (struct dev9_index *idx, const char *name, void *node)
+{
+    struct tree_node *n = find_key (idx, name, node);
+    int_32 entry;
+
+    if (n == (struct tree_node *)0)
+    {
+        return;
+    }
+
+    entry = (int_32)(int_pointer)node_get_value (n) - 1;
+
+    remove_key (idx, name, node);
+
+    /* leave a tombstone so that entry numbers stay put for open cursors */
+    idx->entries[entry].name = (const char *)0;
+    idx->entries[entry].node = (void *)0;
+    idx->live--;
+
+    if ((idx->used > INDEX_INITIAL_ENTRIES) && (idx->live < (idx->used / 2)))
+    {
+        compact (idx);
+    }
+}
+
+void dev9_index_add (struct dev9_index *idx, void *node)
+{
+    add_entry (idx, (const char *)0, node);
+}
+
+char dev9_index_contains (struct dev9_index *idx, void *node)
+{
+    return find_key (idx, (const char *)0, node) != (struct tree_node *)0;
+}
+
+void dev9_index_remove (struct dev9_index *idx, void *node)
+{
+    remove_entry (idx, (const char *)0, node);
+}
+
+void dev9_index_add_named (struct dev9_index *idx, const char *name, void *node)
+{
+    add_entry (idx, name, node);
+}
+
+void dev9_index_remove_named (struct dev9_index *idx, const char *name)
+{
+    remove_entry (idx, name, (void *)0);
+}
+
+void *dev9_index_lookup (struct dev9_index *idx, const char *name)
+{
+    struct tree_node *n = find_key (idx, name, (void *)0);
+
+    if (n == (struct tree_node *)0)
+    {
+        return (void *)0;
+    }
+
+    return idx->entries[(int_32)(int_pointer)node_get_value (n) - 1].node;
+}
+
+/* the entry a cursor continues with, or -1 if that can't be told anymore */
+static int_32 resume (struct dev9_index *idx, struct dev9_index_cursor *c)
+{
+    if (c->next != (void *)0)
+    {
+        struct tree_node *n = find_key (idx, c->next_name, c->next);
+
+        if (n != (struct tree_node *)0)
+        {
+            return (int_32)(int_pointer)node_get_value (n) - 1;
+        }
+    }
+
+    /* the node is gone or the cursor was at the end; the entry number is
+     * still good unless entries have moved since */
+    return (c->generation == idx->generation) ? c->entry : -1;
+}
+
+/* renders the whole entry and copies what fits of it, starting skip bytes
+ * in; returns the number of bytes copied */
+static int_32 read_partial
+        (struct dev9_index_entry *e, int_32 size, int_32 skip,
+         int_32 length, int_8 *data, dev9_index_render render, void *aux)
+{
+    int_8 *scratch = (int_8 *)get_mem (size);
+    int_32 i, n = size - skip;
+
+    if (n > length)
+    {
+        n = length;
+    }
+
+    (void)render (e, aux, size, scratch);
+
+    for (i = 0; i < n; i++)
+    {
+        data[i] = scratch[skip + i];
+    }
+
+    free_mem (size, (void *)scratch);
+
+    return n;
+}
+
+static int_32 read_index
+        (struct dev9_index *idx, struct dev9_index_reader *reader,
+         int_64 offset, int_32 length, int_8 *data,
+         dev9_index_render render, void *aux, char partial)
+{
+    struct dev9_index_cursor *cursor = (struct dev9_index_cursor *)0;
+    int_32 entry = -1, skip = 0, n = 0;
+    unsigned int c;
+
+    for (c = 0; c < DEV9_INDEX_CURSORS; c++)
+    {
+        if (reader->cursor[c].offset == offset)
+        {
+            cursor = &(reader->cursor[c]);
+            entry  = resume (idx, cursor);
+            skip   = cursor->skip;
+            break;
+        }
+    }
+
+    if (cursor == (struct dev9_index_cursor *)0)
+    {
+        cursor = &(reader->cursor[reader->next_cursor]);
+        reader->next_cursor = (reader->next_cursor + 1) % DEV9_INDEX_CURSORS;
+    }
+
+    if (entry < 0)
+    {
+        int_64 pos = 0;
+
+        /* unknown offset: measure the listing up to that point */
+        for (entry = 0, skip = 0; (entry < idx->used) && (pos < offset);
+             entry++)
+        {
+            struct dev9_index_entry *e = &(idx->entries[entry]);
+            int_32 r;
+
+            if (e->node == (void *)0) continue;
+
+            r = render (e, aux, 0, (int_8 *)0);
+
+            if (partial && ((pos + r) > offset))
+            {
+                skip = (int_32)(offset - pos);
+                break;
+            }
+
+            pos += r;
+        }
+    }
+
+    for (; (entry < idx->used) && (n < length); entry++, skip = 0)
+    {
+        struct dev9_index_entry *e = &(idx->entries[entry]);
+        int_32 r, size;
+
+        if (e->node == (void *)0) continue;
+
+        r = render (e, aux, length - n, data + n);
+
+        if (r == 0) continue;
+
+        if ((r <= (length - n)) && (skip == 0))
+        {
+            n += r;
+            continue;
+        }
+
+        if (!partial) break;
+
+        /* a record that's cut off where the read ends, or the rest of one
+         * that was */
+        size  = r;
+        r     = read_partial (e, size, skip, length - n, data + n, render,
+                              aux);
+        n    += r;
+        skip += r;
+
+        if (skip < size) break;
+    }
+
+    if (!partial && (n == 0) && (entry < idx->used) && (length > 0))
+    {
+        /* not even the first entry fits; that's no end of the listing */
+        return -1;
+    }
+
+    cursor->offset     = offset + n;
+    cursor->entry      = entry;
+    cursor->skip       = (entry < idx->used) ? skip : 0;
+    cursor->generation = idx->generation;
+    cursor->next_name  = (entry < idx->used) ? idx->entries[entry].name
+                                             : (const char *)0;
+    cursor->next       = (entry < idx->used) ? idx->entries[entry].node
+                                             : (void *)0;
+
+    return n;
+}
+
+int_32 dev9_index_read
+        (struct dev9_index *idx, struct dev9_index_reader *reader,
+         int_64 offset, int_32 length, int_8 *data,
+         dev9_index_render render, void *aux)
+{
+    return read_index (idx, reader, offset, length, data, render, aux, 0);
+}
+
+int_32 dev9_index_read_partial
+        (struct dev9_index *idx, struct dev9_index_reader *reader,
+         int_64 offset, int_32 length, int_8 *data,
+         dev9_index_render render, void *aux)
+{
+    return read_index (idx, reader, offset, length, data, render, aux, 1);
+}
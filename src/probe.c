@@ -0,0 +1,817 @@
+/*
+ * This file is part of the kyuba.org Dev9 project.
+ * See the appropriate repository at http://git.kyuba.org/ for exact file
+ * modification records.
+*/
+
+/*
+ * Copyright (c) 2008-2014, Kyuba Project Members
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+
+#include <dev9/probe.h>
+#include <dev9/batch.h>
+#include <dev9/devices.h>
+#include <dev9/events.h>
+#include <dev9/rules.h>
+#include <dev9/statistics.h>
+#include <dev9/sysfs.h>
+#include <dev9/views.h>
+#include <curie/memory.h>
+#include <curie/multiplex.h>
+#include <curie/exec.h>
+#include <curie/tree.h>
+#include <sievert/immutable.h>
+
+#include <syscall/syscall.h>
+
+#include <asm/fcntl.h>
+
+struct worker
+{
+    struct sexpr_io *sx;
+    struct io *out;
+    int_32 outstanding;
+    char alive;
+};
+
+struct cached
+{
+    struct dev9_identity identity;
+    int_32 generation;
+    char pending;
+
+    /* the worker couldn't open the node, e.g. because /dev wasn't mounted
+     * yet; nothing is published and the probe is tried again */
+    char failed;
+
+    const char *devpath;
+    const char *node;
+    struct worker *worker;
+};
+
+static struct worker workers[DEV9_PROBE_WORKERS_MAX];
+static unsigned int workers_count = 0;
+static unsigned int workers_wanted = 0;
+static char probe_identities = 0;
+static const char *device_directory = "/dev";
+
+static struct tree identities = TREE_INITIALISER;
+static struct memory_pool pool = MEMORY_POOL_INITIALISER (sizeof (struct cached));
+static int_32 generation = 0;
+static struct dfs *probe_fs = (struct dfs *)0;
+
+static struct io *reply_io = (struct io *)0;
+
+static int_64 probes_requested = 0;
+static int_64 probes_cached    = 0;
+static int_64 probes_failed    = 0;
+
+define_symbol (sym_probe,    "probe");
+define_symbol (sym_identity, "identity");
+define_symbol (sym_attribute, "attribute");
+define_symbol (sym_uuid,     "uuid");
+define_symbol (sym_label,    "label");
+define_symbol (sym_id,       "id");
+define_symbol (sym_ptuuid,   "ptuuid");
+define_symbol (sym_partuuid, "partuuid");
+define_symbol (sym_unreadable, "unreadable");
+define_symbol (sym_action,   "ACTION");
+define_symbol (sym_devpath,  "DEVPATH");
+
+static int read_sysfs (const char *path, char *buf, int length)
+{
+    int fd = sys_open (path, O_RDONLY | O_NONBLOCK, 0), r;
+
+    if (fd < 0) return 0;
+
+    r = sys_read (fd, buf, length - 1);
+    sys_close (fd);
+
+    if (r < 0) r = 0;
+
+    buf[r] = (char)0;
+
+    return r;
+}
+
+/* returns the partition number of a partition, and puts its disk's DEVPATH
+ * in parent; returns 0 for anything that isn't a partition */
+static int partition_of (const char *devpath, char *parent)
+{
+    char path[DEV9_PATH_MAX], partition[16];
+    int_32 pos, i, slash = -1;
+    int number = 0;
+
+    pos = dev9_append_string (path, 0,   DEV9_PATH_MAX, "/sys");
+    pos = dev9_append_string (path, pos, DEV9_PATH_MAX, devpath);
+    pos = dev9_append_string (path, pos, DEV9_PATH_MAX, "/partition");
+    if (pos < 0) return 0;
+
+    if (read_sysfs (path, partition, sizeof (partition)) <= 0) return 0;
+
+    for (i = 0; devpath[i] != (char)0; i++)
+    {
+        if (devpath[i] == '/') slash = i;
+    }
+
+    if ((slash <= 0) || (slash >= DEV9_PATH_MAX)) return 0;
+
+    for (i = 0; i < slash; i++) parent[i] = devpath[i];
+    parent[i] = (char)0;
+
+    for (i = 0; (partition[i] >= '0') && (partition[i] <= '9'); i++)
+    {
+        number = (number * 10) + (partition[i] - '0');
+    }
+
+    return number;
+}
+
+/* disk/by-id names come from the disk's wwid or serial in sysfs; partitions
+ * use their disk's name with -partN appended */
+static void read_id (const char *devpath, int partition, char *id)
+{
+    char path[DEV9_PATH_MAX], buf[DEV9_PROBE_ID];
+    int_32 pos, i;
+    int r;
+
+    id[0] = (char)0;
+
+    pos = dev9_append_string (path, 0,   DEV9_PATH_MAX, "/sys");
+    pos = dev9_append_string (path, pos, DEV9_PATH_MAX, devpath);
+    pos = dev9_append_string (path, pos, DEV9_PATH_MAX, "/device/wwid");
+    if (pos < 0) return;
+
+    if ((r = read_sysfs (path, buf, sizeof (buf))) <= 0)
+    {
+        pos -= 4;
+        pos = dev9_append_string (path, pos, DEV9_PATH_MAX, "serial");
+
+        if ((pos < 0) || ((r = read_sysfs (path, buf, sizeof (buf))) <= 0))
+        {
+            return;
+        }
+    }
+
+    /* skip leading blanks */
+    for (i = 0; (i < r) && ((buf[i] == ' ') || (buf[i] == '\t')); i++);
+
+    dev9_probe_name (id, DEV9_PROBE_ID, (const unsigned char *)buf + i, r - i);
+
+    if ((id[0] != (char)0) && (partition > 0))
+    {
+        pos = 0;
+        while (id[pos] != (char)0) pos++;
+
+        pos = dev9_append_string (id, pos, DEV9_PROBE_ID, "-part");
+        pos = dev9_append_integer (id, pos, DEV9_PROBE_ID, partition);
+
+        if (pos < 0) id[0] = (char)0;
+    }
+}
+
+/* a partition's disk node is next to its own, named after the last
+ * component of the disk's DEVPATH */
+static void read_partuuid
+        (const char *node, const char *parent, int partition,
+         struct dev9_identity *identity)
+{
+    char path[DEV9_PATH_MAX];
+    const char *base = parent;
+    int_32 i, slash = -1, pos;
+    int fd;
+
+    for (i = 0; parent[i] != (char)0; i++)
+    {
+        if (parent[i] == '/') base = parent + i + 1;
+    }
+
+    for (i = 0; node[i] != (char)0; i++)
+    {
+        if (node[i] == '/') slash = i;
+    }
+
+    if ((slash < 0) || (slash >= DEV9_PATH_MAX)) return;
+
+    for (i = 0; i <= slash; i++) path[i] = node[i];
+
+    pos = dev9_append_string (path, slash + 1, DEV9_PATH_MAX, base);
+    if (pos < 0) return;
+
+    fd = sys_open (path, O_RDONLY | O_NONBLOCK, 0);
+
+    if (fd >= 0)
+    {
+        dev9_probe_partition (fd, partition, identity);
+        sys_close (fd);
+    }
+}
+
+/* worker side */
+static void on_attribute_request (sexpr sx, struct sexpr_io *io)
+{
+    char buf[DEV9_SYSFS_ATTRIBUTE_MAX];
+    sexpr gen     = car (cdr (sx));
+    sexpr devpath = car (cdr (cdr (sx)));
+    sexpr name    = car (cdr (cdr (cdr (sx))));
+
+    if (!integerp(gen) || !stringp(devpath) || !stringp(name))
+    {
+        return;
+    }
+
+    sx_write (io, cons (sym_attribute,
+                  cons (gen,
+                  cons (devpath,
+                  cons (name,
+                  cons ((dev9_sysfs_read (sx_string (devpath),
+                                          sx_string (name), buf) < 0)
+                            ? sx_false : make_string (buf),
+                        sx_end_of_list))))));
+    io_flush (reply_io);
+}
+
+static void on_probe_request (sexpr sx, struct sexpr_io *io, void *aux)
+{
+    struct dev9_identity identity;
+    sexpr gen, devpath, node, reply = sx_end_of_list;
+    char parent[DEV9_PATH_MAX];
+    int fd, partition;
+
+    if (consp(sx) && truep(equalp(car (sx), sym_attribute)))
+    {
+        on_attribute_request (sx, io);
+        return;
+    }
+
+    if (!consp(sx) || !truep(equalp(car (sx), sym_probe)))
+    {
+        return;
+    }
+
+    gen     = car (cdr (sx));
+    devpath = car (cdr (cdr (sx)));
+    node    = car (cdr (cdr (cdr (sx))));
+
+    if (!integerp(gen) || !stringp(devpath) || !stringp(node))
+    {
+        return;
+    }
+
+    dev9_identity_clear (&identity);
+
+    fd = sys_open (sx_string (node), O_RDONLY | O_NONBLOCK, 0);
+
+    if (fd < 0)
+    {
+        sx_write (io, cons (sym_identity,
+                      cons (gen, cons (devpath,
+                                       cons (sym_unreadable,
+                                             sx_end_of_list)))));
+        io_flush (reply_io);
+        return;
+    }
+
+    dev9_probe_identify (fd, &identity);
+    sys_close (fd);
+
+    partition = partition_of (sx_string (devpath), parent);
+
+    if (partition > 0)
+    {
+        read_partuuid (sx_string (node), parent, partition, &identity);
+        read_id (parent, partition, identity.id);
+    }
+    else
+    {
+        read_id (sx_string (devpath), 0, identity.id);
+    }
+
+    if (identity.partuuid[0] != (char)0)
+    {
+        reply = cons (cons (sym_partuuid, make_string (identity.partuuid)),
+                      reply);
+    }
+    if (identity.ptuuid[0] != (char)0)
+    {
+        reply = cons (cons (sym_ptuuid, make_string (identity.ptuuid)), reply);
+    }
+    if (identity.id[0] != (char)0)
+    {
+        reply = cons (cons (sym_id, make_string (identity.id)), reply);
+    }
+    if (identity.label[0] != (char)0)
+    {
+        reply = cons (cons (sym_label, make_string (identity.label)), reply);
+    }
+    if (identity.uuid[0] != (char)0)
+    {
+        reply = cons (cons (sym_uuid, make_string (identity.uuid)), reply);
+    }
+
+    sx_write (io, cons (sym_identity, cons (gen, cons (devpath, reply))));
+    io_flush (reply_io);
+}
+
+/* dev9 side */
+static void publish
+        (struct dev9_device *d, struct dev9_identity *identity,
+         struct dfs *fs)
+{
+    static const char *directories[] =
+        { "disk/by-uuid/", "disk/by-label/", "disk/by-id/",
+          "disk/by-partuuid/" };
+    const char *names[] =
+        { identity->uuid, identity->label, identity->id, identity->partuuid };
+    sexpr paths = sx_end_of_list, added = sx_end_of_list, released;
+    char path[DEV9_PATH_MAX];
+    int_32 i, l;
+
+    for (i = 0; i < 4; i++)
+    {
+        const char *name;
+        int_32 cursor = 0;
+        char known = 0;
+
+        if (names[i][0] == (char)0) continue;
+
+        l = dev9_append_string
+                (path, dev9_append_string (path, 0, DEV9_PATH_MAX,
+                                           directories[i]),
+                 DEV9_PATH_MAX, names[i]);
+
+        if (l < 0) continue;
+
+        while ((name = dev9_device_next_name (d, &cursor))
+                   != (const char *)0)
+        {
+            if (dev9_streq (name, path))
+            {
+                known = 1;
+                break;
+            }
+        }
+
+        paths = cons (make_string (path), paths);
+
+        if (!known)
+        {
+            added = cons (car (paths), added);
+        }
+    }
+
+    released = dev9_device_set_probed_names (d, fs, paths);
+
+    /* only tell anyone if the names actually changed; a cached identity
+     * that's published again after the rules ran is a no-op */
+    if (consp(released))
+    {
+        dev9_views_remove (d, released);
+
+        dev9_events_record
+            (cons (cons (sym_action, make_string ("remove")),
+                   cons (cons (sym_devpath, make_string (d->devpath)),
+                         sx_end_of_list)),
+             released);
+    }
+
+    if (consp(added))
+    {
+        dev9_views_update (d, added);
+
+        dev9_events_record
+            (cons (cons (sym_action, make_string ("add")),
+                   cons (cons (sym_devpath, make_string (d->devpath)),
+                         sx_end_of_list)),
+             added);
+    }
+}
+
+static void on_attribute (struct worker *w, sexpr sx)
+{
+    sexpr gen     = car (cdr (sx));
+    sexpr devpath = car (cdr (cdr (sx)));
+    sexpr name    = car (cdr (cdr (cdr (sx))));
+
+    if (w->outstanding > 0) w->outstanding--;
+
+    if (!integerp(gen) || !stringp(devpath) || !stringp(name))
+    {
+        return;
+    }
+
+    if (dev9_sysfs_store (sx_string (devpath), sx_string (name),
+                          (int_32)sx_integer (gen),
+                          car (cdr (cdr (cdr (cdr (sx)))))))
+    {
+        dev9_batch_resume ();
+    }
+}
+
+static void on_identity (sexpr sx, struct sexpr_io *io, void *aux)
+{
+    struct worker *w = (struct worker *)aux;
+    sexpr gen, devpath;
+    struct tree_node *n;
+    struct cached *c;
+    struct dev9_device *d;
+
+    if (consp(sx) && truep(equalp(car (sx), sym_attribute)))
+    {
+        on_attribute (w, sx);
+        return;
+    }
+
+    if (!consp(sx) || !truep(equalp(car (sx), sym_identity)))
+    {
+        return;
+    }
+
+    if (w->outstanding > 0) w->outstanding--;
+
+    gen     = car (cdr (sx));
+    devpath = car (cdr (cdr (sx)));
+
+    if (!integerp(gen) || !stringp(devpath))
+    {
+        return;
+    }
+
+    n = tree_get_node_string (&identities, (char *)sx_string (devpath));
+
+    if (n == (struct tree_node *)0)
+    {
+        return;
+    }
+
+    c = (struct cached *)node_get_value (n);
+
+    /* a later change event asked again; this answer is stale */
+    if (!c->pending || (c->generation != sx_integer (gen)))
+    {
+        return;
+    }
+
+    c->pending = 0;
+
+    if (truep(equalp(car (cdr (cdr (cdr (sx)))), sym_unreadable)))
+    {
+        c->failed = 1;
+        probes_failed++;
+        return;
+    }
+
+    for (sx = cdr (cdr (cdr (sx))); consp(sx); sx = cdr (sx))
+    {
+        sexpr f = car (sx);
+        char *target;
+        int max;
+
+        if (!consp(f) || !stringp(cdr (f))) continue;
+
+        if (truep(equalp(car (f), sym_uuid)))
+        {
+            target = c->identity.uuid;  max = DEV9_PROBE_UUID;
+        }
+        else if (truep(equalp(car (f), sym_label)))
+        {
+            target = c->identity.label; max = DEV9_PROBE_LABEL;
+        }
+        else if (truep(equalp(car (f), sym_id)))
+        {
+            target = c->identity.id;    max = DEV9_PROBE_ID;
+        }
+        else if (truep(equalp(car (f), sym_ptuuid)))
+        {
+            target = c->identity.ptuuid;   max = DEV9_PROBE_UUID;
+        }
+        else if (truep(equalp(car (f), sym_partuuid)))
+        {
+            target = c->identity.partuuid; max = DEV9_PROBE_UUID;
+        }
+        else continue;
+
+        dev9_probe_name (target, max,
+                         (const unsigned char *)sx_string (cdr (f)), max);
+    }
+
+    d = dev9_device_find (sx_string (devpath));
+
+    if ((d != (struct dev9_device *)0) && (probe_fs != (struct dfs *)0))
+    {
+        publish (d, &(c->identity), probe_fs);
+    }
+}
+
+static void retry (struct tree_node *, void *);
+
+static void on_worker_death (struct exec_context *cx, void *aux)
+{
+    ((struct worker *)aux)->alive = 0;
+
+    /* the probes it had are sent to the others, or marked as failed and
+     * tried again later */
+    tree_map (&identities, retry, aux);
+
+    /* whatever it was reading is asked for again, from one of the others
+     * or right here if none are left */
+    dev9_sysfs_abandon ();
+    dev9_batch_resume ();
+}
+
+void dev9_probe_configure (sexpr sx)
+{
+    sexpr directory = car (sx);
+    sexpr count     = car (cdr (sx));
+
+    if (stringp(directory))
+    {
+        device_directory = str_immutable (sx_string (directory));
+    }
+
+    workers_wanted   = 2;
+    probe_identities = 1;
+
+    if (integerp(count) && (sx_integer (count) > 0))
+    {
+        workers_wanted = sx_integer (count);
+    }
+
+    if (workers_wanted > DEV9_PROBE_WORKERS_MAX)
+    {
+        workers_wanted = DEV9_PROBE_WORKERS_MAX;
+    }
+}
+
+void dev9_probe_initialise (void)
+{
+    struct exec_context *contexts[DEV9_PROBE_WORKERS_MAX];
+    int requests[DEV9_PROBE_WORKERS_MAX], replies[DEV9_PROBE_WORKERS_MAX];
+    unsigned int i, j;
+
+    /* without identity probes, one worker is enough to keep sysfs reads
+     * off the main loop */
+    if ((workers_wanted == 0) && dev9_rules_read_attributes ())
+    {
+        workers_wanted = 1;
+    }
+
+    if (workers_wanted == 0)
+    {
+        return;
+    }
+
+    dev9_statistics_register ("probes-requested", &probes_requested);
+    dev9_statistics_register ("probes-cached",    &probes_cached);
+    dev9_statistics_register ("probes-failed",    &probes_failed);
+
+    /* fork all workers before registering anything with the multiplexer, so
+     * none of them inherit the others' pipes */
+    for (i = 0; i < workers_wanted; i++)
+    {
+        int rq[2], rp[2];
+
+        if (sys_pipe (rq) == -1) break;
+        if (sys_pipe (rp) == -1)
+        {
+            sys_close (rq[0]);
+            sys_close (rq[1]);
+            break;
+        }
+
+        contexts[i] = execute (EXEC_CALL_NO_IO, (char **)0, (char **)0);
+
+        switch (contexts[i]->pid)
+        {
+            case -1:
+                sys_close (rq[0]); sys_close (rq[1]);
+                sys_close (rp[0]); sys_close (rp[1]);
+                break;
+            case 0:
+                for (j = 0; j < i; j++)
+                {
+                    sys_close (requests[j]);
+                    sys_close (replies[j]);
+                }
+
+                sys_close (rq[1]);
+                sys_close (rp[0]);
+
+                reply_io = io_open (rp[1]);
+
+                multiplex_add_sexpr (sx_open_io (io_open (rq[0]), reply_io),
+                                     on_probe_request, (void *)0);
+
+                while (multiplex() != mx_nothing_to_do);
+
+                cexit (0);
+            default:
+                sys_close (rq[0]);
+                sys_close (rp[1]);
+
+                requests[i] = rq[1];
+                replies[i]  = rp[0];
+        }
+
+        if (contexts[i]->pid == -1) break;
+    }
+
+    for (j = 0; j < i; j++)
+    {
+        struct worker *w = &(workers[j]);
+
+        sys_fcntl (requests[j], F_SETFD, FD_CLOEXEC);
+        sys_fcntl (replies[j],  F_SETFD, FD_CLOEXEC);
+
+        w->out         = io_open (requests[j]);
+        w->sx          = sx_open_io (io_open (replies[j]), w->out);
+        w->outstanding = 0;
+        w->alive       = 1;
+
+        multiplex_add_sexpr (w->sx, on_identity, (void *)w);
+        multiplex_add_process (contexts[j], on_worker_death, (void *)w);
+    }
+
+    workers_count = j;
+}
+
+static struct worker *idle_worker (void)
+{
+    struct worker *w = (struct worker *)0;
+    unsigned int i;
+
+    for (i = 0; i < workers_count; i++)
+    {
+        if (workers[i].alive &&
+            ((w == (struct worker *)0) ||
+             (workers[i].outstanding < w->outstanding)))
+        {
+            w = &(workers[i]);
+        }
+    }
+
+    return w;
+}
+
+char dev9_probe_attribute
+        (const char *devpath, const char *name, int_32 generation)
+{
+    struct worker *w = idle_worker ();
+
+    if (w == (struct worker *)0)
+    {
+        return 0;
+    }
+
+    sx_write (w->sx, cons (sym_attribute,
+                     cons (make_integer (generation),
+                     cons (make_string (devpath),
+                     cons (make_string (name), sx_end_of_list)))));
+    io_flush (w->out);
+
+    w->outstanding++;
+
+    return 1;
+}
+
+void dev9_probe_forget (const char *devpath)
+{
+    struct tree_node *n = tree_get_node_string (&identities, (char *)devpath);
+
+    if (n == (struct tree_node *)0)
+    {
+        return;
+    }
+
+    free_pool_mem (node_get_value (n));
+    tree_remove_node_string (&identities, (char *)devpath);
+}
+
+/* sends the probe for a cached entry to the least busy worker; returns 0 if
+ * there are none left */
+static char request (struct cached *c)
+{
+    struct worker *w = idle_worker ();
+
+    if (w == (struct worker *)0)
+    {
+        c->pending = 0;
+        c->failed  = 1;
+        return 0;
+    }
+
+    c->generation = ++generation;
+    c->pending    = 1;
+    c->failed     = 0;
+    c->worker     = w;
+
+    sx_write (w->sx, cons (sym_probe,
+                     cons (make_integer (c->generation),
+                     cons (make_string (c->devpath),
+                     cons (make_string (c->node), sx_end_of_list)))));
+    io_flush (w->out);
+
+    w->outstanding++;
+    probes_requested++;
+
+    return 1;
+}
+
+void dev9_probe_device
+        (struct dev9_device *d, const char *devname, char change,
+         struct dfs *fs)
+{
+    struct tree_node *n;
+    struct cached *c;
+    char path[DEV9_PATH_MAX];
+
+    if ((workers_count == 0) || !probe_identities)
+    {
+        return;
+    }
+
+    probe_fs = fs;
+
+    if (change)
+    {
+        dev9_probe_forget (d->devpath);
+    }
+
+    n = tree_get_node_string (&identities, (char *)d->devpath);
+
+    if (n != (struct tree_node *)0)
+    {
+        c = (struct cached *)node_get_value (n);
+
+        if (c->failed)
+        {
+            (void)request (c);
+        }
+        else if (!c->pending)
+        {
+            probes_cached++;
+            publish (d, &(c->identity), fs);
+        }
+
+        return;
+    }
+
+    if (dev9_append_string
+            (path, dev9_append_string
+                       (path, dev9_append_string (path, 0, DEV9_PATH_MAX,
+                                                  device_directory),
+                        DEV9_PATH_MAX, "/"),
+             DEV9_PATH_MAX, devname) < 0)
+    {
+        return;
+    }
+
+    c = (struct cached *)get_pool_mem (&pool);
+
+    dev9_identity_clear (&(c->identity));
+    c->devpath = str_immutable (d->devpath);
+    c->node    = str_immutable (path);
+    c->pending = 0;
+    c->failed  = 0;
+    c->worker  = (struct worker *)0;
+
+    tree_add_node_string_value (&identities, (char *)c->devpath, (void *)c);
+
+    (void)request (c);
+}
+
+static void retry (struct tree_node *n, void *aux)
+{
+    struct cached *c = (struct cached *)node_get_value (n);
+
+    /* either the probes that failed, or those of a worker that died */
+    if ((aux == (void *)0) ? c->failed
+                           : (c->pending && (c->worker == aux)))
+    {
+        (void)request (c);
+    }
+}
+
+void dev9_probe_retry (void)
+{
+    tree_map (&identities, retry, (void *)0);
+}
@@ -0,0 +1,260 @@
+/*
+ * This file is part of the kyuba.org Dev9 project.
+ * See the appropriate repository at http://git.kyuba.org/ for exact file
+ * modification records.
+*/
+
+/*
+ * Copyright (c) 2008-2014, Kyuba Project Members
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+
+#include <dev9/query.h>
+#include <dev9/devices.h>
+#include <dev9/rules.h>
+#include <dev9/index.h>
+#include <curie/memory.h>
+#include <curie/io.h>
+#include <sievert/immutable.h>
+
+struct query
+{
+    const char *subsystem;
+    const char *devpath;
+    const char *path;
+
+    struct dev9_index_reader reader;
+};
+
+static struct query everything;
+
+static struct dfs_directory *query_directory = (struct dfs_directory *)0;
+
+static struct io *query_io = (struct io *)0;
+static struct sexpr_io *query_sx = (struct sexpr_io *)0;
+
+define_symbol (sym_device,       "device");
+define_symbol (sym_subsystem,    "subsystem");
+define_symbol (sym_devpath,      "devpath");
+define_symbol (sym_path,         "path");
+define_symbol (sym_majour,       "major");
+define_symbol (sym_minor,        "minor");
+define_symbol (sym_type,         "type");
+define_symbol (sym_block,        "block");
+define_symbol (sym_character,    "character");
+define_symbol (sym_user,         "user");
+define_symbol (sym_group,        "group");
+define_symbol (sym_mode,         "mode");
+define_symbol (sym_nodes,        "nodes");
+
+static char prefixp (const char *prefix, const char *s)
+{
+    while ((*prefix != (char)0) && (*prefix == *s)) { prefix++; s++; }
+
+    return *prefix == (char)0;
+}
+
+static char query_matches (struct query *q, struct dev9_device *d)
+{
+    if ((q->subsystem != (const char *)0) &&
+        ((d->subsystem == (const char *)0) ||
+         !dev9_streq (q->subsystem, d->subsystem)))
+    {
+        return 0;
+    }
+
+    if ((q->devpath != (const char *)0) && !prefixp (q->devpath, d->devpath))
+    {
+        return 0;
+    }
+
+    if (q->path != (const char *)0)
+    {
+        int_32 i = 0;
+        const char *name;
+
+        while ((name = dev9_device_next_name (d, &i)) != (const char *)0)
+        {
+            if (prefixp (q->path, name)) return 1;
+        }
+
+        return 0;
+    }
+
+    return 1;
+}
+
+static sexpr device_names (struct dev9_device *d)
+{
+    sexpr reversed = sx_end_of_list, names = sx_end_of_list;
+    int_32 i = 0;
+    const char *name;
+
+    while ((name = dev9_device_next_name (d, &i)) != (const char *)0)
+    {
+        reversed = cons (make_string (name), reversed);
+    }
+
+    while (consp(reversed))
+    {
+        names = cons (car (reversed), names);
+        reversed = cdr (reversed);
+    }
+
+    return names;
+}
+
+static int_32 render_device
+        (struct dev9_index_entry *e, void *aux, int_32 length, int_8 *data)
+{
+    struct dev9_device *d = (struct dev9_device *)e->node;
+    sexpr sx = sx_end_of_list;
+    int_32 n, i;
+
+    if (!query_matches ((struct query *)aux, d))
+    {
+        return 0;
+    }
+
+    sx = cons (cons (sym_nodes, device_names (d)), sx);
+    sx = cons (cons (sym_mode,  make_integer (d->mode)), sx);
+    sx = cons (cons (sym_group, make_string (d->group)), sx);
+    sx = cons (cons (sym_user,  make_string (d->user)), sx);
+    sx = cons (cons (sym_type,  d->block_device ? sym_block : sym_character),
+               sx);
+    sx = cons (cons (sym_minor,  make_integer (d->minor)), sx);
+    sx = cons (cons (sym_majour, make_integer (d->majour)), sx);
+
+    if (d->subsystem != (const char *)0)
+    {
+        sx = cons (cons (sym_subsystem, make_string (d->subsystem)), sx);
+    }
+
+    sx = cons (sym_device, cons (make_string (d->devpath), sx));
+
+    query_io->position = 0;
+    query_io->length   = 0;
+
+    sx_write (query_sx, sx);
+
+    n = (int_32)query_io->length;
+
+    if (n > length)
+    {
+        return n;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        data[i] = query_io->buffer[i];
+    }
+
+    return n;
+}
+
+static int_32 on_query_read
+        (struct dfs_file *f, int_64 offset, int_32 length, int_8 *data)
+{
+    struct query *q = (struct query *)f->aux;
+
+    return dev9_index_read_partial
+        (dev9_device_table (), &(q->reader), offset, length, data,
+         render_device, (void *)q);
+}
+
+static struct dfs_file *make_query_file
+        (struct dfs_directory *dir, const char *name, struct query *q)
+{
+    struct dfs_file *f = dfs_mk_file (dir, name, (char *)0, (int_8 *)0, 0,
+                                      (void *)q, on_query_read, (void *)0);
+
+    f->c.mode = 0440;
+    f->c.uid  = "dev9";
+    f->c.gid  = "dev9";
+
+    dev9_index_reader_initialise (&(q->reader));
+
+    return f;
+}
+
+void dev9_query_initialise (struct dfs_directory *dir)
+{
+    query_io = io_open_special ();
+    query_sx = sx_open_io (io_open (-1), query_io);
+
+    everything.subsystem = (const char *)0;
+    everything.devpath   = (const char *)0;
+    everything.path      = (const char *)0;
+
+    make_query_file (dir, "devices", &everything);
+
+    query_directory = dfs_mk_directory (dir, "query");
+    query_directory->c.mode = 0550;
+    query_directory->c.uid  = "dev9";
+    query_directory->c.gid  = "dev9";
+}
+
+void dev9_query_add (sexpr sx)
+{
+    static struct memory_pool pool
+            = MEMORY_POOL_INITIALISER (sizeof (struct query));
+    sexpr name = car (sx);
+    struct query *q;
+
+    if ((query_directory == (struct dfs_directory *)0) || !stringp(name) ||
+        (tree_get_node_string (query_directory->nodes,
+                               (char *)sx_string (name))
+             != (struct tree_node *)0))
+    {
+        return;
+    }
+
+    q = (struct query *)get_pool_mem (&pool);
+
+    q->subsystem = (const char *)0;
+    q->devpath   = (const char *)0;
+    q->path      = (const char *)0;
+
+    for (sx = cdr (sx); consp(sx); sx = cdr (sx))
+    {
+        sexpr f = car (sx);
+
+        if (consp(f) && stringp(cdr (f)))
+        {
+            const char *v = str_immutable (sx_string (cdr (f)));
+
+            if (truep(equalp(car (f), sym_subsystem)))
+            {
+                q->subsystem = v;
+            }
+            else if (truep(equalp(car (f), sym_devpath)))
+            {
+                q->devpath = v;
+            }
+            else if (truep(equalp(car (f), sym_path)))
+            {
+                q->path = v;
+            }
+        }
+    }
+
+    make_query_file (query_directory, sx_string (name), q);
+}
@@ -27,6 +27,11 @@
 */
 
 #include <dev9/rules.h>
+#include <dev9/devices.h>
+#include <dev9/autoload.h>
+#include <dev9/sysfs.h>
+#include <dev9/probe.h>
+#include <dev9/views.h>
 #include <curie/memory.h>
 #include <curie/tree.h>
 #include <duat/filesystem.h>
@@ -35,14 +40,21 @@
 #include <curie/regex.h>
 
 static struct tree regex_tree = TREE_INITIALISER;
+static char reads_attributes = 0;
 
 define_symbol (sym_devpath,       "DEVPATH");
 define_symbol (sym_devbasepath,   "DEV-BASE-PATH");
 define_symbol (sym_majour,        "MAJOR");
 define_symbol (sym_minor,         "MINOR");
 define_symbol (sym_subsystem,     "SUBSYSTEM");
+define_symbol (sym_action,        "ACTION");
+define_symbol (sym_devname,       "DEVNAME");
 define_symbol (sym_match,         "match");
+define_symbol (sym_attr,          "attr");
 define_symbol (sym_when,          "when");
+define_symbol (sym_cond,          "cond");
+define_symbol (sym_else,          "else");
+define_symbol (sym_last,          "last");
 define_symbol (sym_mknod,         "mknod");
 define_symbol (sym_set_group,     "set-group");
 define_symbol (sym_set_user,      "set-user");
@@ -58,6 +70,7 @@ static struct rule {
             struct rule *expression;
             struct rule *rules;
         } when;
+        struct rule *clauses;
         sexpr list;
         const char *string;
         signed long int integer;
@@ -69,15 +82,23 @@ static struct rule {
 struct state
 {
     char block_device;
+    char remove;
+    char change;
+    char stop;
+    char describe;
+    char prefetch;
+    char missing;
     char *user;
     char *group;
     int_32 mode;
     struct sexpr_io *io;
     int_16 majour;
     int_16 minor;
+    struct dfs_device *node;
+    sexpr nodes;
 };
 
-static sexpr lookup_symbol (sexpr environ, sexpr key)
+sexpr dev9_lookup_symbol (sexpr environ, sexpr key)
 {
     sexpr cur = environ;
 
@@ -99,6 +120,66 @@ static sexpr lookup_symbol (sexpr environ, sexpr key)
     return sx_nonexistent;
 }
 
+char dev9_streq (const char *a, const char *b)
+{
+    while ((*a != (char)0) && (*a == *b)) { a++; b++; }
+
+    return *a == *b;
+}
+
+int_32 dev9_append_string (char *buf, int_32 pos, int_32 size, const char *s)
+{
+    if (pos < 0) return -1;
+
+    for (; *s != (char)0; s++, pos++)
+    {
+        if (pos >= (size - 1)) return -1;
+        buf[pos] = *s;
+    }
+
+    buf[pos] = (char)0;
+
+    return pos;
+}
+
+int_32 dev9_append_integer (char *buf, int_32 pos, int_32 size, int_32 i)
+{
+    char digits[12];
+    int d = sizeof (digits) - 1;
+
+    digits[d] = (char)0;
+
+    do
+    {
+        d--;
+        digits[d] = '0' + (i % 10);
+        i /= 10;
+    } while ((i > 0) && (d > 0));
+
+    return dev9_append_string (buf, pos, size, digits + d);
+}
+
+static int_32 append_path_component
+        (char *path, int_32 length, const char *component)
+{
+    if ((length > 0) && (length < (DEV9_PATH_MAX - 1)))
+    {
+        path[length] = '/';
+        length++;
+    }
+
+    while ((*component != (char)0) && (length < (DEV9_PATH_MAX - 1)))
+    {
+        path[length] = *component;
+        component++;
+        length++;
+    }
+
+    path[length] = (char)0;
+
+    return length;
+}
+
 static void dev9_rules_add_deep
         (sexpr sx, struct sexpr_io *io, struct rule **currule)
 {
@@ -130,6 +211,14 @@ static void dev9_rules_add_deep
                 sexpr tsxc_car = car (tsx_car);
                 sexpr tsxc_cdr = cdr (tsx_car);
 
+                /* (attr "name" . "regex") matches against a sysfs attribute */
+                if (truep(equalp(tsxc_car, sym_attr)) && consp(tsxc_cdr) &&
+                    stringp(car (tsxc_cdr)))
+                {
+                    tsxc_cdr = cdr (tsxc_cdr);
+                    reads_attributes = 1;
+                }
+
                 if (symbolp(tsxc_car) && stringp (tsxc_cdr))
                 {
                     sexpr g = rx_compile_sx (tsxc_cdr);
@@ -152,7 +241,11 @@ static void dev9_rules_add_deep
             return;
         }
 
-        dev9_rules_add_deep (car (cdr (sxcdr)), io, &(rule->parameters.when.rules));
+        /* any number of actions, applied in order if the expression holds */
+        for (sexpr tsx = cdr (sxcdr); consp(tsx); tsx = cdr (tsx))
+        {
+            dev9_rules_add_deep (car (tsx), io, &(rule->parameters.when.rules));
+        }
 
         if (rule->parameters.when.rules == (struct rule *)0) {
             free_pool_mem ((void *)rule->parameters.when.expression);
@@ -161,6 +254,60 @@ static void dev9_rules_add_deep
         }
 
         rule->opcode = dev9op_when;
+    } else if (truep(equalp(sxcar, sym_cond))) {
+        /* (cond ((match ...) action ...) ... (else action ...)) is a list
+         * of when rules, of which only the first that matches is applied */
+        rule->parameters.clauses = (struct rule *)0;
+
+        for (sexpr tsx = sxcdr; consp(tsx); tsx = cdr (tsx))
+        {
+            sexpr clause = car (tsx);
+            struct rule *when, **cur;
+
+            if (!consp(clause)) continue;
+
+            if (truep(equalp(car (clause), sym_else)))
+            {
+                clause = cons (cons (sym_match, sx_end_of_list),
+                               cdr (clause));
+            }
+
+            when = (struct rule *)get_pool_mem (&pool);
+            when->opcode = dev9op_when;
+            when->next   = (struct rule *)0;
+            when->parameters.when.expression = (struct rule *)0;
+            when->parameters.when.rules      = (struct rule *)0;
+
+            dev9_rules_add_deep (car (clause), io,
+                                 &(when->parameters.when.expression));
+
+            if (when->parameters.when.expression == (struct rule *)0) {
+                free_pool_mem ((void *)when);
+                continue;
+            }
+
+            /* unlike a plain when, a clause without any actions is kept:
+             * if it matches, it still ends the cond */
+            for (sexpr asx = cdr (clause); consp(asx); asx = cdr (asx))
+            {
+                dev9_rules_add_deep (car (asx), io,
+                                     &(when->parameters.when.rules));
+            }
+
+            for (cur = &(rule->parameters.clauses);
+                 (*cur) != (struct rule *)0; cur = &((*cur)->next));
+
+            (*cur) = when;
+        }
+
+        if (rule->parameters.clauses == (struct rule *)0) {
+            free_pool_mem ((void *)rule);
+            return;
+        }
+
+        rule->opcode = dev9op_cond;
+    } else if (truep(equalp(sxcar, sym_last))) {
+        rule->opcode = dev9op_last;
     } else if (truep(equalp(sxcar, sym_mknod))) {
         rule->opcode = dev9op_mknod;
         rule->parameters.list = sxcdr;
@@ -201,6 +348,22 @@ static void dev9_rules_add_deep
     (*currule) = rule;
 }
 
+static sexpr  dev9_rules_apply_deep
+        (sexpr sx, struct dfs *fs, struct rule *rule,
+         struct state *state);
+
+static void dev9_rules_apply_list
+        (sexpr sx, struct dfs *fs, struct rule *rule,
+         struct state *state)
+{
+    while ((rule != (struct rule *)0) && !state->stop)
+    {
+        (void)dev9_rules_apply_deep (sx, fs, rule, state);
+
+        rule = rule->next;
+    }
+}
+
 static sexpr  dev9_rules_apply_deep
         (sexpr sx, struct dfs *fs, struct rule *rule,
          struct state *state)
@@ -219,6 +382,14 @@ static sexpr  dev9_rules_apply_deep
                     {
                         sexpr tsxc_car = car (tsx_car);
                         sexpr tsxc_cdr = cdr (tsx_car);
+                        sexpr attribute = sx_nonexistent;
+
+                        if (truep(equalp(tsxc_car, sym_attr)) &&
+                            consp(tsxc_cdr) && stringp(car (tsxc_cdr)))
+                        {
+                            attribute = car (tsxc_cdr);
+                            tsxc_cdr  = cdr (tsxc_cdr);
+                        }
 
                         if (symbolp(tsxc_car) && stringp (tsxc_cdr))
                         {
@@ -229,7 +400,38 @@ static sexpr  dev9_rules_apply_deep
 
                             if (n == (void *)0) return sx_false;
 
-                            against = lookup_symbol (sx, tsxc_car);
+                            if (stringp(attribute))
+                            {
+                                /* only read once the match gets this far */
+                                sexpr devpath
+                                        = dev9_lookup_symbol (sx, sym_devpath);
+
+                                if (!stringp(devpath)) return sx_false;
+
+                                if (state->prefetch &&
+                                    !dev9_sysfs_prefetch
+                                        (sx_string (devpath),
+                                         sx_string (attribute)))
+                                {
+                                    state->missing = 1;
+                                    return sx_false;
+                                }
+
+                                /* a description's DEVPATH is made up, so
+                                 * don't cache what it has or hasn't got */
+                                against = (state->describe &&
+                                           !state->prefetch)
+                                    ? dev9_sysfs_attribute_uncached
+                                          (sx_string (devpath),
+                                           sx_string (attribute))
+                                    : dev9_sysfs_attribute
+                                          (sx_string (devpath),
+                                           sx_string (attribute));
+                            }
+                            else
+                            {
+                                against = dev9_lookup_symbol (sx, tsxc_car);
+                            }
 
                             if (!stringp(against)) return sx_false;
 
@@ -249,15 +451,41 @@ static sexpr  dev9_rules_apply_deep
             if (truep(dev9_rules_apply_deep
                 (sx, fs, rule->parameters.when.expression, state)))
             {
-                return dev9_rules_apply_deep
+                dev9_rules_apply_list
                         (sx, fs, rule->parameters.when.rules, state);
+                return sx_true;
             }
 
             return sx_false;
+        case dev9op_cond:
+            {
+                struct rule *clause = rule->parameters.clauses;
+
+                for (; (clause != (struct rule *)0) && !state->stop;
+                     clause = clause->next)
+                {
+                    if (truep(dev9_rules_apply_deep (sx, fs, clause, state)))
+                    {
+                        return sx_true;
+                    }
+                }
+            }
+            return sx_false;
+        case dev9op_last:
+            state->stop = (char)1;
+            return sx_true;
         case dev9op_mknod:
+            if (state->describe)
+            {
+                return sx_true;
+            }
             {
                 struct dfs_directory *dir = fs->root;
                 sexpr cur = rule->parameters.list;
+                char path[DEV9_PATH_MAX];
+                int_32 plen = 0;
+
+                path[0] = (char)0;
 
                 while (consp(cur) && !eolp(cur))
                 {
@@ -267,7 +495,7 @@ static sexpr  dev9_rules_apply_deep
 
                     if (symbolp(sxcar))
                     {
-                        sexpr sxx = lookup_symbol (sx, sxcar);
+                        sexpr sxx = dev9_lookup_symbol (sx, sxcar);
 
                         if (stringp(sxx)) {
                             dname = (char *)sx_string(sxx);
@@ -280,45 +508,74 @@ static sexpr  dev9_rules_apply_deep
 
                     if (dname != (char *)0)
                     {
-                        struct tree_node *n
-                                = tree_get_node_string (dir->nodes, dname);
+                        struct dfs_node_common *n
+                                = dev9_directory_lookup (dir, dname);
+
+                        plen = append_path_component (path, plen, dname);
+
+                        if (state->remove)
+                        {
+                            /* never create anything while removing nodes */
+                            if (n == (struct dfs_node_common *)0)
+                            {
+                                return sx_false;
+                            }
+                        }
 
                         if (eolp(sxcdr))
                         {
                             struct dfs_device *d;
-                            if (n == (struct tree_node *)0) {
-                                d = dfs_mk_device (dir, dname,
-                                                   state->block_device ?
-                                                           dfs_block_device :
-                                                           dfs_character_device,
-                                                   state->majour,
-                                                   state->minor);
-                            } else {
-                                d = (struct dfs_device *)node_get_value (n);
 
-                                if (d->c.type != dft_device) {
+                            if (state->remove)
+                            {
+                                d = (struct dfs_device *)n;
+
+                                /* only remove the node if it's still
+                                 * pointing at the device that went away */
+                                if ((d->c.type != dft_device) ||
+                                    (d->majour != state->majour) ||
+                                    (d->minor  != state->minor))
+                                {
                                     return sx_false;
                                 }
 
-                                d->majour = state->majour;
-                                d->minor = state->minor;
-                                d->type = state->block_device ?
-                                              dfs_block_device :
-                                              dfs_character_device;
+                                if (dev9_device_unlink
+                                        (fs, path, d->majour, d->minor))
+                                {
+                                    state->nodes = cons
+                                            (make_string (path),
+                                             state->nodes);
+                                }
+                                return sx_true;
+                            }
+
+                            /* the first node made for the event is the
+                             * device's; further names share it */
+                            d = dev9_mk_alias (dir, dname, state->node,
+                                               state->block_device,
+                                               state->majour, state->minor);
+
+                            if (d == (struct dfs_device *)0) return sx_false;
+
+                            if (state->node == (struct dfs_device *)0)
+                            {
+                                state->node = d;
                             }
 
                             d->c.uid  = state->user;
                             d->c.muid = state->user;
                             d->c.gid  = state->group;
                             d->c.mode = (d->c.mode & ~07777)| state->mode;
+
+                            state->nodes = cons (make_string (path),
+                                                 state->nodes);
                         }
                         else
                         {
-                            if (n == (struct tree_node *)0) {
-                                dir = dfs_mk_directory(dir, dname);
-                                dir->c.mode |= 0111;
+                            if (n == (struct dfs_node_common *)0) {
+                                dir = dev9_mk_directory (dir, dname);
                             } else {
-                                dir =(struct dfs_directory *)node_get_value (n);
+                                dir = (struct dfs_directory *)n;
                             }
 
                             if (dir->c.type != dft_directory) return sx_false;
@@ -351,26 +608,22 @@ void dev9_rules_add (sexpr sx, struct sexpr_io *io)
     dev9_rules_add_deep (sx, io, &rules_list);
 }
 
-void dev9_rules_apply (sexpr sx, struct dfs *fs)
+/* reads the uevent attributes the rules depend on into the state, and adds
+ * DEV-BASE-PATH to them */
+static sexpr prepare
+        (sexpr sx, struct state *state, const char **devpath,
+         const char **subsystem)
 {
     sexpr tsx;
-    struct rule *rule = rules_list;
-    struct state state =
-    {
-        .block_device = 0,
-        .user         = "root",
-        .group        = "group",
-        .mode         = 0660,
-        .majour       = 0,
-        .minor        = 0
-    };
 
-    tsx = lookup_symbol (sx, sym_devpath);
+    tsx = dev9_lookup_symbol (sx, sym_devpath);
     if (stringp(tsx))
     {
         char *x = (char *)sx_string (tsx);
         char *y = x;
 
+        *devpath = x;
+
         for (char *c = x; (*c) != 0; c++)
         {
             if ((*c) == '/') y = c + 1;
@@ -379,48 +632,234 @@ void dev9_rules_apply (sexpr sx, struct dfs *fs)
         sx = cons(cons (sym_devbasepath, make_string(y)), sx);
     }
 
-    tsx = lookup_symbol (sx, sym_majour);
+    tsx = dev9_lookup_symbol (sx, sym_majour);
     if (stringp(tsx))
     {
         char *x = (char *)sx_string (tsx);
         int i = 0;
         while (x[i])
         {
-            state.majour *= 10;
-            state.majour += (char)(x[i] - '0');
+            state->majour *= 10;
+            state->majour += (char)(x[i] - '0');
             i++;
         }
     }
 
-    tsx = lookup_symbol (sx, sym_minor);
+    tsx = dev9_lookup_symbol (sx, sym_minor);
     if (stringp(tsx))
     {
         char *x = (char *)sx_string (tsx);
         int i = 0;
         while (x[i])
         {
-            state.minor *= 10;
-            state.minor += (char)(x[i] - '0');
+            state->minor *= 10;
+            state->minor += (char)(x[i] - '0');
             i++;
         }
     }
 
-    tsx = lookup_symbol (sx, sym_subsystem);
+    tsx = dev9_lookup_symbol (sx, sym_subsystem);
     if (stringp(tsx))
     {
-        state.user  = (char *)str_immutable(sx_string (tsx));
-        state.group = state.user;
+        state->user  = (char *)str_immutable(sx_string (tsx));
+        state->group = state->user;
+        *subsystem   = state->user;
+    }
+
+    tsx = dev9_lookup_symbol (sx, sym_action);
+    if (stringp(tsx))
+    {
+        const char *a = sx_string (tsx);
+
+        state->remove = (a[0] == 'r') && (a[1] == 'e') && (a[2] == 'm');
+        state->change = (a[0] == 'c') && (a[1] == 'h') && (a[2] == 'a');
+    }
+
+    return sx;
+}
+
+void dev9_rules_describe (sexpr sx, struct dev9_device *d)
+{
+    const char *devpath = (const char *)0;
+    struct state state =
+    {
+        .block_device = 0,
+        .remove       = 0,
+        .change       = 0,
+        .stop         = 0,
+        .describe     = 1,
+        .prefetch     = 0,
+        .missing      = 0,
+        .user         = "root",
+        .group        = "group",
+        .mode         = 0660,
+        .majour       = 0,
+        .minor        = 0,
+        .node         = (struct dfs_device *)0,
+        .nodes        = sx_end_of_list
+    };
+
+    sx = prepare (sx, &state, &devpath, &(d->subsystem));
+
+    dev9_rules_apply_list (sx, (struct dfs *)0, rules_list, &state);
+
+    d->user         = state.user;
+    d->group        = state.group;
+    d->mode         = state.mode;
+    d->majour       = state.majour;
+    d->minor        = state.minor;
+    d->block_device = state.block_device;
+}
+
+char dev9_rules_ready (sexpr sx)
+{
+    const char *devpath = (const char *)0;
+    const char *subsystem = (const char *)0;
+    struct state state =
+    {
+        .block_device = 0,
+        .remove       = 0,
+        .change       = 0,
+        .stop         = 0,
+        .describe     = 1,
+        .prefetch     = 1,
+        .missing      = 0,
+        .user         = "root",
+        .group        = "group",
+        .mode         = 0660,
+        .majour       = 0,
+        .minor        = 0,
+        .node         = (struct dfs_device *)0,
+        .nodes        = sx_end_of_list
+    };
+
+    if (!reads_attributes)
+    {
+        return 1;
+    }
+
+    sx = prepare (sx, &state, &devpath, &subsystem);
+
+    /* removes don't run the rules for devices we know, and the attributes
+     * of one we don't know are gone already */
+    if (state.remove)
+    {
+        return 1;
+    }
+
+    dev9_rules_apply_list (sx, (struct dfs *)0, rules_list, &state);
+
+    return !state.missing;
+}
+
+char dev9_rules_read_attributes (void)
+{
+    return reads_attributes;
+}
+
+sexpr dev9_rules_apply (sexpr sx, struct dfs *fs)
+{
+    sexpr tsx, released;
+    struct rule *rule = rules_list;
+    struct dev9_device *device = (struct dev9_device *)0;
+    const char *devpath = (const char *)0;
+    const char *subsystem = (const char *)0;
+    struct state state =
+    {
+        .block_device = 0,
+        .remove       = 0,
+        .change       = 0,
+        .stop         = 0,
+        .describe     = 0,
+        .prefetch     = 0,
+        .missing      = 0,
+        .user         = "root",
+        .group        = "group",
+        .mode         = 0660,
+        .majour       = 0,
+        .minor        = 0,
+        .node         = (struct dfs_device *)0,
+        .nodes        = sx_end_of_list
+    };
+
+    sx = prepare (sx, &state, &devpath, &subsystem);
+
+    if (devpath != (const char *)0)
+    {
+        device = dev9_device_find (devpath);
+    }
+
+    if (state.remove && (device != (struct dev9_device *)0))
+    {
+        /* the record knows all of the device's names, no need to run the
+         * rules and hope they come up with the same ones again */
+        struct dev9_device gone = *device;
+
+        dev9_probe_forget (devpath);
+        released = dev9_device_drop (device, fs);
+        dev9_views_remove (&gone, released);
+
+        /* bring back the device's placeholders, its module might get
+         * reloaded */
+        dev9_autoload_restore (fs, gone.majour, gone.minor);
+
+        return released;
     }
 
     if ((state.majour == 0) && (state.minor == 0))
     {
-        return;
+        return sx_end_of_list;
     }
 
-    while (rule != (struct rule *)0)
+    dev9_rules_apply_list (sx, fs, rule, &state);
+
+    if (devpath == (const char *)0)
     {
-        (void)dev9_rules_apply_deep (sx, fs, rule, &state);
+        return state.nodes;
+    }
 
-        rule = rule->next;
+    if (state.remove)
+    {
+        /* the rules may have looked at attributes of the departed device */
+        dev9_sysfs_invalidate (devpath);
+        return state.nodes;
     }
+
+    device = dev9_device_get (devpath);
+
+    device->subsystem    = subsystem;
+    device->user         = state.user;
+    device->group        = state.group;
+    device->mode         = state.mode;
+    device->majour       = state.majour;
+    device->minor        = state.minor;
+    device->block_device = state.block_device;
+
+    released = dev9_device_set_names (device, fs, state.nodes);
+
+    while (consp(released))
+    {
+        state.nodes = cons (car (released), state.nodes);
+        released = cdr (released);
+    }
+
+    dev9_views_update (device, state.nodes);
+    dev9_autoload_arrived (state.majour, state.minor);
+
+    if (state.block_device)
+    {
+        tsx = dev9_lookup_symbol (sx, sym_devname);
+
+        if (!stringp(tsx))
+        {
+            tsx = dev9_lookup_symbol (sx, sym_devbasepath);
+        }
+
+        if (stringp(tsx))
+        {
+            dev9_probe_device (device, sx_string (tsx), state.change, fs);
+        }
+    }
+
+    return state.nodes;
 }
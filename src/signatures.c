@@ -0,0 +1,359 @@
+/*
+ * This file is part of the kyuba.org Dev9 project.
+ * See the appropriate repository at http://git.kyuba.org/ for exact file
+ * modification records.
+*/
+
+/*
+ * Copyright (c) 2008-2014, Kyuba Project Members
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+
+#include <dev9/signatures.h>
+#include <curie/int.h>
+
+#include <syscall/syscall.h>
+
+#define PROBE_BUFFER 4096
+
+static char memeq (const unsigned char *a, const char *b, int length)
+{
+    int i;
+
+    for (i = 0; i < length; i++)
+    {
+        if (a[i] != (unsigned char)b[i]) return 0;
+    }
+
+    return 1;
+}
+
+static void hex (char *out, unsigned int byte, char upper)
+{
+    const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+
+    out[0] = digits[(byte >> 4) & 0xf];
+    out[1] = digits[byte & 0xf];
+}
+
+static void format_uuid (char *out, const unsigned char *u)
+{
+    int i, o = 0;
+
+    for (i = 0; i < 16; i++)
+    {
+        if ((i == 4) || (i == 6) || (i == 8) || (i == 10))
+        {
+            out[o] = '-';
+            o++;
+        }
+
+        hex (out + o, u[i], 0);
+        o += 2;
+    }
+
+    out[o] = (char)0;
+
+    /* an all-zero UUID is as good as none */
+    for (i = 0; i < 16; i++)
+    {
+        if (u[i] != 0) return;
+    }
+
+    out[0] = (char)0;
+}
+
+/* GPT stores its GUIDs with the first three fields little-endian */
+static void format_guid (char *out, const unsigned char *g)
+{
+    static const int order[16] =
+        { 3, 2, 1, 0, 5, 4, 7, 6, 8, 9, 10, 11, 12, 13, 14, 15 };
+    unsigned char u[16];
+    int i;
+
+    for (i = 0; i < 16; i++)
+    {
+        u[i] = g[order[i]];
+    }
+
+    format_uuid (out, u);
+}
+
+/* MBR disk signatures are shown as a 32-bit hex number */
+static void format_signature (char *out, const unsigned char *s)
+{
+    hex (out,     s[3], 0);
+    hex (out + 2, s[2], 0);
+    hex (out + 4, s[1], 0);
+    hex (out + 6, s[0], 0);
+    out[8] = (char)0;
+
+    if ((s[0] | s[1] | s[2] | s[3]) == 0)
+    {
+        out[0] = (char)0;
+    }
+}
+
+static int_64 little_endian (const unsigned char *b, int length)
+{
+    int_64 r = 0;
+
+    while (length > 0)
+    {
+        length--;
+        r = (r << 8) | b[length];
+    }
+
+    return r;
+}
+
+/* vfat volume serials are shown as XXXX-XXXX */
+static void format_serial (char *out, const unsigned char *s)
+{
+    hex (out,     s[3], 1);
+    hex (out + 2, s[2], 1);
+    out[4] = '-';
+    hex (out + 5, s[1], 1);
+    hex (out + 7, s[0], 1);
+    out[9] = (char)0;
+}
+
+void dev9_probe_name (char *out, int max, const unsigned char *in, int length)
+{
+    int i, o = 0, end = 0;
+
+    for (i = 0; (i < length) && (in[i] != 0) && (o < (max - 1)); i++)
+    {
+        unsigned char c = in[i];
+
+        if ((c <= ' ') || (c == '/') || (c == 0x7f))
+        {
+            out[o] = '_';
+        }
+        else
+        {
+            out[o] = (char)c;
+            end = o + 1;
+        }
+
+        o++;
+    }
+
+    out[end] = (char)0;
+
+    if ((out[0] == '.') && ((out[1] == (char)0) ||
+                            ((out[1] == '.') && (out[2] == (char)0))))
+    {
+        out[0] = (char)0;
+    }
+}
+
+static char read_at (int fd, int_64 offset, unsigned char *buf, int length)
+{
+    if (sys_lseek (fd, offset, 0) < 0) return 0;
+
+    return sys_read (fd, (char *)buf, length) == length;
+}
+
+/* the GPT header is in the second sector, which is either at 512 or at 4096
+ * for disks with 4k sectors */
+static char gpt_header (int fd, unsigned char *b, int_64 *sector)
+{
+    static const int_64 sizes[2] = { 512, 4096 };
+    int i;
+
+    for (i = 0; i < 2; i++)
+    {
+        if (read_at (fd, sizes[i], b, 92) && memeq (b, "EFI PART", 8))
+        {
+            if (sector != (int_64 *)0)
+            {
+                *sector = sizes[i];
+            }
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* boot sectors end in 55 aa too; a partition table has nothing but 0x00 and
+ * 0x80 in its entries' boot flags */
+static char mbr_valid (const unsigned char *b)
+{
+    int i;
+
+    if ((b[510] != 0x55) || (b[511] != 0xaa)) return 0;
+
+    for (i = 0; i < 4; i++)
+    {
+        unsigned char flag = b[446 + (i * 16)];
+
+        if ((flag != 0x00) && (flag != 0x80)) return 0;
+    }
+
+    return 1;
+}
+
+void dev9_identity_clear (struct dev9_identity *identity)
+{
+    identity->uuid[0]     = (char)0;
+    identity->label[0]    = (char)0;
+    identity->id[0]       = (char)0;
+    identity->ptuuid[0]   = (char)0;
+    identity->partuuid[0] = (char)0;
+}
+
+void dev9_probe_identify (int fd, struct dev9_identity *identity)
+{
+    unsigned char b[PROBE_BUFFER];
+
+    identity->uuid[0]   = (char)0;
+    identity->label[0]  = (char)0;
+    identity->ptuuid[0] = (char)0;
+
+    /* a disk with a GPT won't have a filesystem at its start */
+    if (gpt_header (fd, b, (int_64 *)0))
+    {
+        format_guid (identity->ptuuid, b + 56);
+        return;
+    }
+
+    if (read_at (fd, 0, b, PROBE_BUFFER))
+    {
+        /* ext2/3/4: superblock at 1024, magic 0xEF53 */
+        if ((b[1024 + 0x38] == 0x53) && (b[1024 + 0x39] == 0xef))
+        {
+            format_uuid (identity->uuid, b + 1024 + 0x68);
+            dev9_probe_name (identity->label, DEV9_PROBE_LABEL, b + 1024 + 0x78, 16);
+            return;
+        }
+
+        if (memeq (b, "XFSB", 4))
+        {
+            format_uuid (identity->uuid, b + 32);
+            dev9_probe_name (identity->label, DEV9_PROBE_LABEL, b + 108, 12);
+            return;
+        }
+
+        /* swap with 4k pages */
+        if (memeq (b + 4086, "SWAPSPACE2", 10))
+        {
+            format_uuid (identity->uuid, b + 1036);
+            dev9_probe_name (identity->label, DEV9_PROBE_LABEL, b + 1052, 16);
+            return;
+        }
+
+        if ((b[510] == 0x55) && (b[511] == 0xaa))
+        {
+            const unsigned char *serial = (const unsigned char *)0;
+            const unsigned char *label  = (const unsigned char *)0;
+
+            if (memeq (b + 0x52, "FAT32   ", 8))
+            {
+                serial = b + 0x43;
+                label  = b + 0x47;
+            }
+            else if (memeq (b + 0x36, "FAT1", 4))
+            {
+                serial = b + 0x27;
+                label  = b + 0x2b;
+            }
+
+            if (serial != (const unsigned char *)0)
+            {
+                format_serial (identity->uuid, serial);
+
+                if (!memeq (label, "NO NAME    ", 11))
+                {
+                    dev9_probe_name (identity->label, DEV9_PROBE_LABEL, label, 11);
+                }
+                return;
+            }
+
+            /* hybrid images have both a partition table and an iso9660
+             * filesystem, so keep looking */
+            if (mbr_valid (b))
+            {
+                format_signature (identity->ptuuid, b + 440);
+            }
+        }
+    }
+
+    /* iso9660 primary volume descriptor */
+    if (read_at (fd, 0x8000, b, 2048) && (b[0] == 1) && memeq (b + 1, "CD001", 5))
+    {
+        dev9_probe_name (identity->label, DEV9_PROBE_LABEL, b + 40, 32);
+        return;
+    }
+
+    if (read_at (fd, 0x10000, b, PROBE_BUFFER) && memeq (b + 0x40, "_BHRfS_M", 8))
+    {
+        format_uuid (identity->uuid, b + 0x20);
+        dev9_probe_name (identity->label, DEV9_PROBE_LABEL, b + 0x12b, 256);
+        return;
+    }
+}
+
+void dev9_probe_partition (int fd, int number, struct dev9_identity *identity)
+{
+    unsigned char b[PROBE_BUFFER];
+    int_64 sector;
+
+    identity->partuuid[0] = (char)0;
+
+    if (number <= 0)
+    {
+        return;
+    }
+
+    if (gpt_header (fd, b, &sector))
+    {
+        int_64 entries = little_endian (b + 72, 8);
+        int_64 count   = little_endian (b + 80, 4);
+        int_64 size    = little_endian (b + 84, 4);
+
+        if ((number > count) || (size < 32) || (size > PROBE_BUFFER))
+        {
+            return;
+        }
+
+        if (read_at (fd, (entries * sector) + ((number - 1) * size), b, 32))
+        {
+            format_guid (identity->partuuid, b + 16);
+        }
+        return;
+    }
+
+    if (read_at (fd, 0, b, 512) && mbr_valid (b))
+    {
+        char *p = identity->partuuid;
+
+        format_signature (p, b + 440);
+
+        if ((p[0] != (char)0) && (number < 0x100))
+        {
+            p[8] = '-';
+            hex (p + 9, (unsigned int)number, 0);
+            p[11] = (char)0;
+        }
+    }
+}
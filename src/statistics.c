@@ -0,0 +1,105 @@
+/*
+ * This file is part of the kyuba.org Dev9 project.
+ * See the appropriate repository at http://git.kyuba.org/ for exact file
+ * modification records.
+*/
+
+/*
+ * Copyright (c) 2008-2014, Kyuba Project Members
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+
+#include <dev9/statistics.h>
+#include <curie/memory.h>
+#include <curie/io.h>
+
+#define STATISTICS_MAX 32
+
+static struct counter
+{
+    sexpr name;
+    int_64 *value;
+} counters[STATISTICS_MAX];
+
+static unsigned int counters_count = 0;
+
+static struct io *statistics_io = (struct io *)0;
+static struct sexpr_io *statistics_sx = (struct sexpr_io *)0;
+
+define_symbol (sym_statistics, "statistics");
+
+void dev9_statistics_register (const char *name, int_64 *value)
+{
+    if (counters_count == STATISTICS_MAX)
+    {
+        return;
+    }
+
+    counters[counters_count].name  = make_symbol (name);
+    counters[counters_count].value = value;
+    counters_count++;
+}
+
+static int_32 on_statistics_read
+        (struct dfs_file *f, int_64 offset, int_32 length, int_8 *data)
+{
+    sexpr sx = sx_end_of_list;
+    unsigned int i;
+    int_32 n, j;
+
+    for (i = counters_count; i > 0; i--)
+    {
+        sx = cons (cons (counters[i-1].name,
+                         make_integer (*(counters[i-1].value))),
+                   sx);
+    }
+
+    statistics_io->position = 0;
+    statistics_io->length   = 0;
+
+    sx_write (statistics_sx, cons (sym_statistics, sx));
+
+    f->length = statistics_io->length;
+
+    if (offset >= statistics_io->length)
+    {
+        return 0;
+    }
+
+    n = (int_32)(statistics_io->length - offset);
+    if (n > length) n = length;
+
+    for (j = 0; j < n; j++)
+    {
+        data[j] = statistics_io->buffer[offset + j];
+    }
+
+    return n;
+}
+
+struct dfs_file *dev9_statistics_initialise (struct dfs_directory *dir)
+{
+    statistics_io = io_open_special ();
+    statistics_sx = sx_open_io (io_open (-1), statistics_io);
+
+    return dfs_mk_file (dir, "statistics", (char *)0, (int_8 *)0, 0,
+                        (void *)0, on_statistics_read, (void *)0);
+}
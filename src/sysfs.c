@@ -0,0 +1,378 @@
+/*
+ * This file is part of the kyuba.org Dev9 project.
+ * See the appropriate repository at http://git.kyuba.org/ for exact file
+ * modification records.
+*/
+
+/*
+ * Copyright (c) 2008-2014, Kyuba Project Members
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+
+#include <dev9/sysfs.h>
+#include <dev9/probe.h>
+#include <dev9/rules.h>
+#include <dev9/statistics.h>
+#include <curie/memory.h>
+#include <curie/tree.h>
+#include <sievert/immutable.h>
+
+#include <syscall/syscall.h>
+
+#include <asm/fcntl.h>
+
+struct attribute
+{
+    const char *name;
+    char *value;      /* (char *)0 if the attribute couldn't be read */
+    int_32 length;
+
+    /* set while a worker is reading it; only the answer to the request
+     * with the same generation is taken */
+    char pending;
+    int_32 generation;
+
+    struct attribute *next;
+};
+
+struct cache
+{
+    struct attribute *attributes;
+};
+
+static struct tree caches = TREE_INITIALISER;
+
+static struct memory_pool attribute_pool
+        = MEMORY_POOL_INITIALISER (sizeof (struct attribute));
+static struct memory_pool cache_pool
+        = MEMORY_POOL_INITIALISER (sizeof (struct cache));
+
+static int_32 generation = 0;
+
+static int_64 attribute_reads      = 0;
+static int_64 attribute_requests   = 0;
+static int_64 attribute_cache_hits = 0;
+
+/* attribute names stay below the device's directory */
+static char name_valid (const char *name)
+{
+    const char *c;
+
+    if ((*name == (char)0) || (*name == '/')) return 0;
+
+    for (c = name; *c != (char)0; c++)
+    {
+        if ((c[0] == '.') && (c[1] == '.')) return 0;
+    }
+
+    return 1;
+}
+
+int_32 dev9_sysfs_read (const char *devpath, const char *name, char *buf)
+{
+    char path[DEV9_PATH_MAX];
+    int_32 pos;
+    int fd, r;
+
+    if (!name_valid (name)) return -1;
+
+    pos = dev9_append_string (path, 0, DEV9_PATH_MAX, "/sys");
+    pos = dev9_append_string (path, pos, DEV9_PATH_MAX, devpath);
+    pos = dev9_append_string (path, pos, DEV9_PATH_MAX, "/");
+    pos = dev9_append_string (path, pos, DEV9_PATH_MAX, name);
+
+    if (pos < 0) return -1;
+
+    /* a single, bounded read. This blocks for as long as the driver's
+     * show() takes; sysfs ignores O_NONBLOCK */
+    fd = sys_open (path, O_RDONLY, 0);
+
+    if (fd < 0) return -1;
+
+    r = sys_read (fd, buf, DEV9_SYSFS_ATTRIBUTE_MAX - 1);
+    sys_close (fd);
+
+    if (r < 0) return -1;
+
+    while ((r > 0) && ((buf[r - 1] == '\n') || (buf[r - 1] == (char)0))) r--;
+
+    buf[r] = (char)0;
+
+    return r;
+}
+
+static void set_value (struct attribute *a, const char *value)
+{
+    int_32 i;
+
+    a->pending = 0;
+
+    if (value == (const char *)0)
+    {
+        return;
+    }
+
+    for (i = 0; value[i] != (char)0; i++);
+
+    a->length = i + 1;
+    a->value  = (char *)get_mem (a->length);
+
+    for (i = 0; i < a->length; i++)
+    {
+        a->value[i] = value[i];
+    }
+}
+
+static void read_attribute (const char *devpath, struct attribute *a)
+{
+    char buf[DEV9_SYSFS_ATTRIBUTE_MAX];
+
+    attribute_reads++;
+
+    set_value (a, (dev9_sysfs_read (devpath, a->name, buf) < 0)
+                  ? (const char *)0 : buf);
+}
+
+static void register_statistics (void)
+{
+    static char registered = 0;
+
+    if (!registered)
+    {
+        dev9_statistics_register ("attribute-reads", &attribute_reads);
+        dev9_statistics_register ("attribute-requests",
+                                  &attribute_requests);
+        dev9_statistics_register ("attribute-cache-hits",
+                                  &attribute_cache_hits);
+        registered = 1;
+    }
+}
+
+static struct cache *get_cache (const char *devpath, char create)
+{
+    struct tree_node *n = tree_get_node_string (&caches, (char *)devpath);
+    struct cache *c;
+
+    if (n != (struct tree_node *)0)
+    {
+        return (struct cache *)node_get_value (n);
+    }
+
+    if (!create)
+    {
+        return (struct cache *)0;
+    }
+
+    c = (struct cache *)get_pool_mem (&cache_pool);
+    c->attributes = (struct attribute *)0;
+
+    tree_add_node_string_value (&caches, (char *)devpath, (void *)c);
+
+    return c;
+}
+
+static struct attribute *get_attribute
+        (struct cache *c, const char *name, char *created)
+{
+    struct attribute *a;
+
+    for (a = c->attributes; a != (struct attribute *)0; a = a->next)
+    {
+        if (dev9_streq (a->name, name))
+        {
+            *created = 0;
+            return a;
+        }
+    }
+
+    a = (struct attribute *)get_pool_mem (&attribute_pool);
+    a->name       = str_immutable (name);
+    a->value      = (char *)0;
+    a->length     = 0;
+    a->pending    = 0;
+    a->generation = 0;
+    a->next       = c->attributes;
+    c->attributes = a;
+
+    *created = 1;
+
+    return a;
+}
+
+static sexpr value_of (struct attribute *a)
+{
+    if (a->value == (char *)0)
+    {
+        return sx_nonexistent;
+    }
+
+    return make_string (a->value);
+}
+
+sexpr dev9_sysfs_attribute (const char *devpath, const char *name)
+{
+    struct attribute *a;
+    char created;
+
+    register_statistics ();
+
+    a = get_attribute (get_cache (devpath, 1), name, &created);
+
+    if (created || a->pending)
+    {
+        /* nobody asked for it ahead of time, or the answer isn't in yet;
+         * the answer will be ignored once it is */
+        a->generation = 0;
+        read_attribute (devpath, a);
+    }
+    else
+    {
+        attribute_cache_hits++;
+    }
+
+    return value_of (a);
+}
+
+char dev9_sysfs_prefetch (const char *devpath, const char *name)
+{
+    struct attribute *a;
+    char created;
+
+    register_statistics ();
+
+    a = get_attribute (get_cache (devpath, 1), name, &created);
+
+    if (!created)
+    {
+        return !a->pending;
+    }
+
+    a->pending    = 1;
+    a->generation = ++generation;
+
+    if (dev9_probe_attribute (devpath, a->name, a->generation))
+    {
+        attribute_requests++;
+        return 0;
+    }
+
+    /* no workers to do it for us */
+    read_attribute (devpath, a);
+
+    return 1;
+}
+
+char dev9_sysfs_store
+        (const char *devpath, const char *name, int_32 generation,
+         sexpr value)
+{
+    struct cache *c = get_cache (devpath, 0);
+    struct attribute *a;
+
+    if (c == (struct cache *)0)
+    {
+        return 0;
+    }
+
+    for (a = c->attributes; a != (struct attribute *)0; a = a->next)
+    {
+        if (a->pending && (a->generation == generation) &&
+            dev9_streq (a->name, name))
+        {
+            attribute_reads++;
+            set_value (a, stringp(value) ? sx_string (value)
+                                         : (const char *)0);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+sexpr dev9_sysfs_attribute_uncached (const char *devpath, const char *name)
+{
+    char buf[DEV9_SYSFS_ATTRIBUTE_MAX];
+
+    if (dev9_sysfs_read (devpath, name, buf) < 0)
+    {
+        return sx_nonexistent;
+    }
+
+    return make_string (buf);
+}
+
+static void free_attributes (struct attribute *a)
+{
+    while (a != (struct attribute *)0)
+    {
+        struct attribute *next = a->next;
+
+        if (a->value != (char *)0)
+        {
+            free_mem (a->length, (void *)a->value);
+        }
+
+        free_pool_mem ((void *)a);
+        a = next;
+    }
+}
+
+void dev9_sysfs_invalidate (const char *devpath)
+{
+    struct cache *c = get_cache (devpath, 0);
+
+    if (c == (struct cache *)0)
+    {
+        return;
+    }
+
+    tree_remove_node_string (&caches, (char *)devpath);
+
+    free_attributes (c->attributes);
+    free_pool_mem ((void *)c);
+}
+
+static void drop_pending (struct tree_node *n, void *aux)
+{
+    struct cache *c = (struct cache *)node_get_value (n);
+    struct attribute **a = &(c->attributes);
+
+    while ((*a) != (struct attribute *)0)
+    {
+        if ((*a)->pending)
+        {
+            struct attribute *p = *a;
+
+            *a = p->next;
+            p->next = (struct attribute *)0;
+            free_attributes (p);
+        }
+        else
+        {
+            a = &((*a)->next);
+        }
+    }
+}
+
+void dev9_sysfs_abandon (void)
+{
+    tree_map (&caches, drop_pending, (void *)0);
+}
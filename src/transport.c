@@ -0,0 +1,1059 @@
+/*
+ * This file is part of the kyuba.org Dev9 project.
+ * See the appropriate repository at http://git.kyuba.org/ for exact file
+ * modification records.
+*/
+
+/*
+ * Copyright (c) 2008-2014, Kyuba Project Members
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+#include <dev9/transport.h>
+#include <dev9/autoload.h>
+#include <dev9/devices.h>
+#include <dev9/index.h>
+#include <dev9/rules.h>
+#include <curie/memory.h>
+#include <curie/multiplex.h>
+#include <curie/network.h>
+#include <curie/tree.h>
+#include <duat/9p-server.h>
+#include <syscall/syscall.h>
+
+#include <asm/fcntl.h>
+
+/* the 9p messages the relay needs to look at */
+#define P9_TVERSION 100
+#define P9_RVERSION 101
+#define P9_TATTACH  104
+#define P9_RATTACH  105
+#define P9_RERROR   107
+#define P9_TFLUSH   108
+#define P9_TWALK    110
+#define P9_RWALK    111
+#define P9_TOPEN    112
+#define P9_ROPEN    113
+#define P9_TCREATE  114
+#define P9_RCREATE  115
+#define P9_TREAD    116
+#define P9_RREAD    117
+#define P9_TCLUNK   120
+#define P9_TREMOVE  122
+
+#define P9_HEADER   7
+#define P9_MAXWELEM 16
+#define P9_IOHDRSZ  11
+#define P9_QTDIR     0x80
+#define P9_QTSYMLINK 0x02
+#define P9_DMDIR     0x80000000UL
+#define P9_DMSYMLINK 0x02000000UL
+#define P9_DMDEVICE  0x00800000UL
+#define P9_NONUNAME  0xffffffffUL
+#define P9_ENODEV    19
+#define P9_EINVAL    22
+
+/* anything bigger than this before a Tversion is garbage */
+#define TRANSPORT_MESSAGE_MAX (1024*1024*16)
+
+struct fid
+{
+    struct dfs_node_common *node;
+
+    /* set once the fid is opened on a directory whose listing dev9 keeps */
+    struct dev9_index_reader *reader;
+};
+
+/* a request duat hasn't replied to yet, by tag; a walk holds the entries
+ * it goes through in duat's tree until the reply is in */
+struct request
+{
+    unsigned int type;
+    unsigned long fid;
+    unsigned long newfid;
+    unsigned int names;
+    struct dfs_node_common *node;
+
+    unsigned int materialised;
+    struct dfs_directory *directory[P9_MAXWELEM];
+    const char *name[P9_MAXWELEM];
+};
+
+/* a walk to a placeholder whose driver is being loaded, held back until
+ * the device shows up or the load fails */
+struct parked
+{
+    unsigned int tag;
+    int_16 majour;
+    int_16 minor;
+    int_32 size;
+    int_8 *message;
+
+    struct parked *next;
+};
+
+struct connection
+{
+    struct dfs *fs;
+    struct io *client;
+    struct io *reply;
+    struct io *server;
+    struct io *server_reply;
+
+    unsigned long msize;
+    char dotu;
+    int_8 *buffer;
+
+    struct tree *fids;
+    struct tree *requests;
+    struct parked *parked;
+
+    struct connection *next;
+};
+
+static struct connection *connections = (struct connection *)0;
+
+static struct memory_pool connection_pool
+        = MEMORY_POOL_INITIALISER (sizeof (struct connection));
+static struct memory_pool fid_pool
+        = MEMORY_POOL_INITIALISER (sizeof (struct fid));
+static struct memory_pool request_pool
+        = MEMORY_POOL_INITIALISER (sizeof (struct request));
+static struct memory_pool reader_pool
+        = MEMORY_POOL_INITIALISER (sizeof (struct dev9_index_reader));
+static struct memory_pool parked_pool
+        = MEMORY_POOL_INITIALISER (sizeof (struct parked));
+
+static unsigned int get_16 (const int_8 *b)
+{
+    const unsigned char *u = (const unsigned char *)b;
+
+    return (unsigned int)u[0] | ((unsigned int)u[1] << 8);
+}
+
+static unsigned long get_32 (const int_8 *b)
+{
+    return (unsigned long)get_16 (b) | ((unsigned long)get_16 (b + 2) << 16);
+}
+
+static int_64 get_64 (const int_8 *b)
+{
+    return (int_64)get_32 (b) | ((int_64)get_32 (b + 4) << 32);
+}
+
+static int_8 *put_8 (int_8 *b, unsigned int v)
+{
+    *b = (int_8)(v & 0xff);
+
+    return b + 1;
+}
+
+static int_8 *put_16 (int_8 *b, unsigned int v)
+{
+    return put_8 (put_8 (b, v), v >> 8);
+}
+
+static int_8 *put_32 (int_8 *b, unsigned long v)
+{
+    return put_16 (put_16 (b, (unsigned int)(v & 0xffff)),
+                   (unsigned int)((v >> 16) & 0xffff));
+}
+
+static int_8 *put_64 (int_8 *b, int_64 v)
+{
+    return put_32 (put_32 (b, (unsigned long)(v & 0xffffffff)),
+                   (unsigned long)((v >> 32) & 0xffffffff));
+}
+
+static int_8 *put_string (int_8 *b, const char *s, int_32 length)
+{
+    int_32 i;
+
+    b = put_16 (b, length);
+
+    for (i = 0; i < length; i++)
+    {
+        b[i] = (int_8)s[i];
+    }
+
+    return b + length;
+}
+
+static int_32 string_length (const char *s)
+{
+    int_32 l = 0;
+
+    if (s == (const char *)0) return 0;
+
+    while (s[l] != (char)0) l++;
+
+    return l;
+}
+
+static struct fid *get_fid (struct connection *c, unsigned long fid)
+{
+    struct tree_node *n = tree_get_node (c->fids, (int_pointer)fid);
+
+    return (n == (struct tree_node *)0) ? (struct fid *)0
+                                        : (struct fid *)node_get_value (n);
+}
+
+static void free_fid (struct fid *f)
+{
+    if (f->reader != (struct dev9_index_reader *)0)
+    {
+        free_pool_mem ((void *)f->reader);
+    }
+
+    if (f->node != (struct dfs_node_common *)0)
+    {
+        dev9_node_release (f->node);
+    }
+
+    free_pool_mem ((void *)f);
+}
+
+static void set_fid
+        (struct connection *c, unsigned long fid,
+         struct dfs_node_common *node)
+{
+    struct fid *f = get_fid (c, fid);
+
+    if (node != (struct dfs_node_common *)0)
+    {
+        dev9_node_hold (node);
+    }
+
+    if (f == (struct fid *)0)
+    {
+        f = (struct fid *)get_pool_mem (&fid_pool);
+        tree_add_node_value (c->fids, (int_pointer)fid, (void *)f);
+    }
+    else
+    {
+        if (f->reader != (struct dev9_index_reader *)0)
+        {
+            free_pool_mem ((void *)f->reader);
+        }
+
+        if (f->node != (struct dfs_node_common *)0)
+        {
+            dev9_node_release (f->node);
+        }
+    }
+
+    f->node   = node;
+    f->reader = (struct dev9_index_reader *)0;
+}
+
+static void drop_fid (struct connection *c, unsigned long fid)
+{
+    struct fid *f = get_fid (c, fid);
+
+    if (f != (struct fid *)0)
+    {
+        tree_remove_node (c->fids, (int_pointer)fid);
+        free_fid (f);
+    }
+}
+
+static void free_fid_node (struct tree_node *n, void *aux)
+{
+    free_fid ((struct fid *)node_get_value (n));
+}
+
+static void finish_request (struct request *r)
+{
+    unsigned int i;
+
+    for (i = 0; i < r->materialised; i++)
+    {
+        dev9_directory_dematerialise (r->directory[i], r->name[i]);
+    }
+
+    if (r->node != (struct dfs_node_common *)0)
+    {
+        dev9_node_release (r->node);
+    }
+
+    free_pool_mem ((void *)r);
+}
+
+static void free_request_node (struct tree_node *n, void *aux)
+{
+    finish_request ((struct request *)node_get_value (n));
+}
+
+static void forget_request (struct connection *c, unsigned int tag)
+{
+    struct tree_node *n = tree_get_node (c->requests, (int_pointer)tag);
+
+    if (n != (struct tree_node *)0)
+    {
+        finish_request ((struct request *)node_get_value (n));
+        tree_remove_node (c->requests, (int_pointer)tag);
+    }
+}
+
+static void free_parked (struct parked *p)
+{
+    free_mem (p->size, (void *)p->message);
+    free_pool_mem ((void *)p);
+}
+
+static void park
+        (struct connection *c, unsigned int tag, struct dfs_device *node,
+         const int_8 *m, int_32 size)
+{
+    struct parked *p = (struct parked *)get_pool_mem (&parked_pool);
+    int_32 i;
+
+    p->tag     = tag;
+    p->majour  = node->majour;
+    p->minor   = node->minor;
+    p->size    = size;
+    p->message = (int_8 *)get_mem (size);
+    p->next    = c->parked;
+
+    for (i = 0; i < size; i++)
+    {
+        p->message[i] = m[i];
+    }
+
+    c->parked = p;
+}
+
+/* returns 1 if there was a walk parked under the tag */
+static char unpark (struct connection *c, unsigned int tag)
+{
+    struct parked **p;
+
+    for (p = &(c->parked); (*p) != (struct parked *)0; p = &((*p)->next))
+    {
+        if ((*p)->tag == tag)
+        {
+            struct parked *q = *p;
+
+            *p = q->next;
+            free_parked (q);
+
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static void drop_fids (struct connection *c)
+{
+    tree_map (c->fids, free_fid_node, (void *)0);
+    tree_destroy (c->fids);
+    c->fids = tree_create ();
+}
+
+/* a new request for the tag; a tag that's in use again belongs to a
+ * request that was flushed */
+static struct request *remember
+        (struct connection *c, unsigned int tag, unsigned int type,
+         unsigned long fid)
+{
+    struct request *r;
+
+    (void)unpark (c, tag);
+    forget_request (c, tag);
+
+    r = (struct request *)get_pool_mem (&request_pool);
+
+    r->type         = type;
+    r->fid          = fid;
+    r->newfid       = 0;
+    r->names        = 0;
+    r->node         = (struct dfs_node_common *)0;
+    r->materialised = 0;
+
+    tree_add_node_value (c->requests, (int_pointer)tag, (void *)r);
+
+    return r;
+}
+
+static void set_target (struct request *r, struct dfs_node_common *node)
+{
+    if (node != (struct dfs_node_common *)0)
+    {
+        dev9_node_hold (node);
+    }
+
+    r->node = node;
+}
+
+/* work out where the walk ends up, and put the entries it goes through
+ * into duat's tree; the target stays unknown if that can't be told from
+ * here */
+static void walk_target
+        (struct connection *c, struct request *r, const int_8 *b,
+         int_32 length)
+{
+    struct fid *f = get_fid (c, r->fid);
+    struct dfs_node_common *node;
+    char name[DEV9_PATH_MAX];
+    unsigned int i;
+
+    if ((f == (struct fid *)0) || (f->node == (struct dfs_node_common *)0) ||
+        (r->names > P9_MAXWELEM))
+    {
+        return;
+    }
+
+    node = f->node;
+
+    for (i = 0; i < r->names; i++)
+    {
+        struct dfs_directory *dir = (struct dfs_directory *)node;
+        const char *m;
+        int_32 l, j;
+
+        if ((length < 2) || (node->type != dft_directory))
+        {
+            return;
+        }
+
+        l = (int_32)get_16 (b);
+
+        if ((l >= DEV9_PATH_MAX) || (l > (length - 2)))
+        {
+            return;
+        }
+
+        for (j = 0; j < l; j++)
+        {
+            name[j] = (char)b[2 + j];
+        }
+        name[l] = (char)0;
+
+        b      += 2 + l;
+        length -= 2 + l;
+
+        if (dev9_streq (name, ".."))
+        {
+            if (dir->parent != (struct dfs_directory *)0)
+            {
+                node = &(dir->parent->c);
+            }
+            continue;
+        }
+
+        node = dev9_directory_lookup (dir, name);
+
+        if (node == (struct dfs_node_common *)0)
+        {
+            return;
+        }
+
+        if ((m = dev9_directory_materialise (dir, name)) != (const char *)0)
+        {
+            r->directory[r->materialised] = dir;
+            r->name[r->materialised]      = m;
+            r->materialised++;
+        }
+    }
+
+    set_target (r, node);
+}
+
+/* one 9p stat structure per entry, with the 9P2000.u fields if those were
+ * negotiated; the kernel only looks at the names, qids and types when it
+ * lists a directory, attributes come from a stat after the walk */
+static int_32 render_stat
+        (struct dev9_index_entry *e, void *aux, int_32 length, int_8 *data)
+{
+    struct connection *c = (struct connection *)aux;
+    struct dfs_node_common *node = (struct dfs_node_common *)e->node;
+    char extension[DEV9_PATH_MAX];
+    unsigned long mode = (unsigned long)node->mode;
+    unsigned int qtype = 0;
+    int_32 size, lname, luid, lgid, lmuid, lext = 0;
+    int_8 *b = data;
+
+    extension[0] = (char)0;
+
+    switch (node->type)
+    {
+        case dft_directory:
+            qtype = P9_QTDIR;
+            mode |= P9_DMDIR;
+            break;
+        case dft_symlink:
+            qtype = P9_QTSYMLINK;
+            if (c->dotu)
+            {
+                mode |= P9_DMSYMLINK;
+                lext  = dev9_append_string
+                    (extension, 0, sizeof (extension),
+                     ((struct dfs_symlink *)node)->symlink);
+            }
+            break;
+        case dft_device:
+            if (c->dotu)
+            {
+                struct dfs_device *d = (struct dfs_device *)node;
+
+                mode |= P9_DMDEVICE;
+                lext  = dev9_append_string
+                    (extension, 0, sizeof (extension),
+                     (d->type == dfs_block_device) ? "b " : "c ");
+                lext  = dev9_append_integer
+                    (extension, lext, sizeof (extension), d->majour);
+                lext  = dev9_append_string
+                    (extension, lext, sizeof (extension), " ");
+                lext  = dev9_append_integer
+                    (extension, lext, sizeof (extension), d->minor);
+            }
+            break;
+        default:
+            break;
+    }
+
+    if (lext < 0)
+    {
+        lext = 0;
+    }
+
+    lname = string_length (e->name);
+    luid  = string_length (node->uid);
+    lgid  = string_length (node->gid);
+    lmuid = string_length (node->muid);
+
+    size = 2 + 2 + 4 + 13 + 4 + 4 + 4 + 8
+         + 2 + lname + 2 + luid + 2 + lgid + 2 + lmuid;
+
+    if (c->dotu)
+    {
+        size += 2 + lext + 4 + 4 + 4;
+    }
+
+    if (size > length)
+    {
+        return size;
+    }
+
+    b = put_16 (b, size - 2);
+    b = put_16 (b, 0);
+    b = put_32 (b, 0);
+    b = put_8  (b, qtype);
+    b = put_32 (b, 0);
+    b = put_64 (b, (int_64)(int_pointer)node);
+    b = put_32 (b, mode);
+    b = put_32 (b, (unsigned long)node->atime);
+    b = put_32 (b, (unsigned long)node->mtime);
+    b = put_64 (b, (node->type == dft_directory) ? 0 : node->length);
+    b = put_string (b, e->name, lname);
+    b = put_string (b, node->uid, luid);
+    b = put_string (b, node->gid, lgid);
+    b = put_string (b, node->muid, lmuid);
+
+    if (c->dotu)
+    {
+        b = put_string (b, extension, lext);
+        b = put_32 (b, P9_NONUNAME);
+        b = put_32 (b, P9_NONUNAME);
+        b = put_32 (b, P9_NONUNAME);
+    }
+
+    return size;
+}
+
+/* an Rerror as if duat had sent it; 9P2000.u clients get the errno as
+ * well */
+static void reply_error
+        (struct connection *c, unsigned int tag, const char *ename,
+         unsigned long number)
+{
+    int_8 m[P9_HEADER + 2 + 64 + 4];
+    int_32 length = string_length (ename);
+    int_32 size = P9_HEADER + 2 + length + (c->dotu ? 4 : 0);
+    int_8 *b = m;
+
+    if (c->reply == (struct io *)0)
+    {
+        return;
+    }
+
+    b = put_32 (b, size);
+    b = put_8  (b, P9_RERROR);
+    b = put_16 (b, tag);
+    b = put_string (b, ename, length);
+
+    if (c->dotu)
+    {
+        b = put_32 (b, number);
+    }
+
+    io_write (c->reply, (char *)m, size);
+    io_flush (c->reply);
+}
+
+/* answer a Tread on a listing dev9 keeps */
+static void read_listing
+        (struct connection *c, unsigned int tag, struct fid *f,
+         int_64 offset, unsigned long count)
+{
+    struct dev9_index *listing
+            = dev9_directory_listing ((struct dfs_directory *)f->node);
+    int_32 n = 0;
+    int_8 *b = c->buffer;
+
+    if (count > (c->msize - P9_IOHDRSZ))
+    {
+        count = c->msize - P9_IOHDRSZ;
+    }
+
+    /* the directory was released and is empty now */
+    if (listing != (struct dev9_index *)0)
+    {
+        n = dev9_index_read (listing, f->reader, offset, (int_32)count,
+                             c->buffer + P9_IOHDRSZ, render_stat,
+                             (void *)c);
+    }
+
+    if (n < 0)
+    {
+        /* an empty Rread would end the listing early */
+        reply_error (c, tag, "read count too small", P9_EINVAL);
+        return;
+    }
+
+    b = put_32 (b, P9_IOHDRSZ + n);
+    b = put_8  (b, P9_RREAD);
+    b = put_16 (b, tag);
+    b = put_32 (b, n);
+
+    io_write (c->reply, (char *)c->buffer, P9_IOHDRSZ + n);
+}
+
+static void on_request (struct connection *c, const int_8 *m, int_32 size)
+{
+    unsigned int type = (unsigned char)m[4];
+    unsigned int tag  = get_16 (m + 5);
+
+    switch (type)
+    {
+        case P9_TVERSION:
+            drop_fids (c);
+            break;
+        case P9_TATTACH:
+            if (size >= (P9_HEADER + 4))
+            {
+                set_target (remember (c, tag, type, get_32 (m + 7)),
+                            &(c->fs->root->c));
+            }
+            break;
+        case P9_TWALK:
+            if (size >= (P9_HEADER + 10))
+            {
+                struct request *r = remember (c, tag, type, get_32 (m + 7));
+
+                r->newfid = get_32 (m + 11);
+                r->names  = get_16 (m + 15);
+
+                walk_target (c, r, m + 17, size - 17);
+
+                /* duat would answer with the placeholder right away, which
+                 * is no good if the driver for it is on its way */
+                if ((r->node != (struct dfs_node_common *)0) &&
+                    (r->node->type == dft_device) &&
+                    dev9_autoload_walk (r->node))
+                {
+                    park (c, tag, (struct dfs_device *)r->node, m, size);
+                    return;
+                }
+            }
+            break;
+        case P9_TFLUSH:
+            /* duat never saw a parked walk, so its Rflush for the tag is
+             * all the client needs */
+            if ((size >= (P9_HEADER + 2)) && unpark (c, get_16 (m + 7)))
+            {
+                forget_request (c, get_16 (m + 7));
+            }
+            break;
+        case P9_TOPEN:
+        case P9_TCREATE:
+            if (size >= (P9_HEADER + 4))
+            {
+                (void)remember (c, tag, type, get_32 (m + 7));
+            }
+            break;
+        case P9_TREAD:
+            if ((size >= (P9_HEADER + 16)) && (c->buffer != (int_8 *)0))
+            {
+                struct fid *f = get_fid (c, get_32 (m + 7));
+
+                if ((f != (struct fid *)0) &&
+                    (f->reader != (struct dev9_index_reader *)0))
+                {
+                    read_listing (c, tag, f, get_64 (m + 11),
+                                  get_32 (m + 19));
+                    return;
+                }
+            }
+            break;
+        case P9_TCLUNK:
+        case P9_TREMOVE:
+            /* the fid is gone either way */
+            if (size >= (P9_HEADER + 4))
+            {
+                drop_fid (c, get_32 (m + 7));
+            }
+            break;
+    }
+
+    io_write (c->server, (char *)m, size);
+}
+
+static void on_version (struct connection *c, const int_8 *m, int_32 size)
+{
+    unsigned long msize;
+
+    if (size < (P9_HEADER + 6))
+    {
+        return;
+    }
+
+    msize = get_32 (m + 7);
+
+    if (c->buffer != (int_8 *)0)
+    {
+        free_mem (c->msize, (void *)c->buffer);
+        c->buffer = (int_8 *)0;
+    }
+
+    c->dotu  = (get_16 (m + 11) == 8) && (size >= (P9_HEADER + 14)) &&
+               (m[13 + 6] == '.') && (m[13 + 7] == 'u');
+    c->msize = msize;
+
+    if (msize > P9_IOHDRSZ)
+    {
+        c->buffer = (int_8 *)get_mem (msize);
+    }
+}
+
+static void on_reply (struct connection *c, const int_8 *m, int_32 size)
+{
+    unsigned int type = (unsigned char)m[4];
+    unsigned int tag  = get_16 (m + 5);
+    struct tree_node *n = tree_get_node (c->requests, (int_pointer)tag);
+
+    if (type == P9_RVERSION)
+    {
+        on_version (c, m, size);
+    }
+
+    if (n != (struct tree_node *)0)
+    {
+        struct request *r = (struct request *)node_get_value (n);
+        struct fid *f;
+
+        /* anything but the matching R-message is an Rerror */
+        if (type == (r->type + 1)) switch (r->type)
+        {
+            case P9_TATTACH:
+                set_fid (c, r->fid, r->node);
+                break;
+            case P9_TWALK:
+                /* newfid only exists if every name could be walked */
+                if ((size >= (P9_HEADER + 2)) &&
+                    (get_16 (m + 7) == r->names))
+                {
+                    set_fid (c, r->newfid, r->node);
+                }
+                break;
+            case P9_TOPEN:
+                f = get_fid (c, r->fid);
+
+                if ((f != (struct fid *)0) &&
+                    (f->node != (struct dfs_node_common *)0) &&
+                    (f->node->type == dft_directory) &&
+                    (f->reader == (struct dev9_index_reader *)0) &&
+                    (dev9_directory_listing ((struct dfs_directory *)f->node)
+                         != (struct dev9_index *)0))
+                {
+                    f->reader = (struct dev9_index_reader *)get_pool_mem
+                            (&reader_pool);
+                    dev9_index_reader_initialise (f->reader);
+                }
+                break;
+            case P9_TCREATE:
+                set_fid (c, r->fid, (struct dfs_node_common *)0);
+                break;
+        }
+
+        tree_remove_node (c->requests, (int_pointer)tag);
+        finish_request (r);
+    }
+
+    io_write (c->reply, (char *)m, size);
+}
+
+/* hand every complete message in the buffer to the handler; returns 0 if
+ * the stream doesn't make sense */
+static char read_messages
+        (struct connection *c, struct io *io,
+         void (*handle)(struct connection *, const int_8 *, int_32))
+{
+    unsigned long limit = (c->msize > 0) ? c->msize : TRANSPORT_MESSAGE_MAX;
+
+    while ((io->length - io->position) >= P9_HEADER)
+    {
+        const int_8 *m = (const int_8 *)(io->buffer + io->position);
+        unsigned long size = get_32 (m);
+
+        if ((size < P9_HEADER) || (size > limit))
+        {
+            return 0;
+        }
+
+        if ((io->length - io->position) < size)
+        {
+            break;
+        }
+
+        handle (c, m, (int_32)size);
+
+        io->position += size;
+    }
+
+    return 1;
+}
+
+static void release (struct connection *c)
+{
+    struct connection **cp;
+
+    if ((c->client != (struct io *)0) ||
+        (c->server_reply != (struct io *)0))
+    {
+        return;
+    }
+
+    tree_map (c->fids, free_fid_node, (void *)0);
+    tree_destroy (c->fids);
+    tree_map (c->requests, free_request_node, (void *)0);
+    tree_destroy (c->requests);
+
+    while (c->parked != (struct parked *)0)
+    {
+        struct parked *p = c->parked;
+
+        c->parked = p->next;
+        free_parked (p);
+    }
+
+    for (cp = &connections; (*cp) != (struct connection *)0;
+         cp = &((*cp)->next))
+    {
+        if ((*cp) == c)
+        {
+            *cp = c->next;
+            break;
+        }
+    }
+
+    if (c->buffer != (int_8 *)0)
+    {
+        free_mem (c->msize, (void *)c->buffer);
+    }
+
+    free_pool_mem ((void *)c);
+}
+
+static void on_client_read (struct io *io, void *aux)
+{
+    struct connection *c = (struct connection *)aux;
+
+    if (c->server == (struct io *)0)
+    {
+        io->position = io->length;
+        return;
+    }
+
+    if (!read_messages (c, io, on_request))
+    {
+        /* out of step with the client; let duat drop the session */
+        io->position = io->length;
+        io_close (c->server);
+        c->server = (struct io *)0;
+        return;
+    }
+
+    io_flush (c->server);
+    io_flush (c->reply);
+}
+
+static void on_client_close (struct io *io, void *aux)
+{
+    struct connection *c = (struct connection *)aux;
+
+    c->client = (struct io *)0;
+
+    if (c->server != (struct io *)0)
+    {
+        io_close (c->server);
+        c->server = (struct io *)0;
+    }
+
+    release (c);
+}
+
+static void on_server_read (struct io *io, void *aux)
+{
+    struct connection *c = (struct connection *)aux;
+
+    if (!read_messages (c, io, on_reply))
+    {
+        io->position = io->length;
+    }
+
+    io_flush (c->reply);
+}
+
+static void on_server_close (struct io *io, void *aux)
+{
+    struct connection *c = (struct connection *)aux;
+
+    c->server_reply = (struct io *)0;
+
+    if (c->reply != (struct io *)0)
+    {
+        io_close (c->reply);
+        c->reply = (struct io *)0;
+    }
+
+    release (c);
+}
+
+static void close_on_exec (int fd)
+{
+    (void)sys_fcntl (fd, F_SETFD, FD_CLOEXEC);
+}
+
+void dev9_transport_add_io (struct io *in, struct io *out, struct dfs *fs)
+{
+    struct connection *c;
+    int up[2], down[2];
+
+    if (sys_pipe (up) == -1)
+    {
+        multiplex_add_d9s_io (in, out, fs);
+        return;
+    }
+
+    if (sys_pipe (down) == -1)
+    {
+        sys_close (up[0]);
+        sys_close (up[1]);
+        multiplex_add_d9s_io (in, out, fs);
+        return;
+    }
+
+    close_on_exec (up[0]);
+    close_on_exec (up[1]);
+    close_on_exec (down[0]);
+    close_on_exec (down[1]);
+
+    c = (struct connection *)get_pool_mem (&connection_pool);
+
+    c->fs           = fs;
+    c->client       = in;
+    c->reply        = out;
+    c->server       = io_open (up[1]);
+    c->server_reply = io_open (down[0]);
+    c->msize        = 0;
+    c->dotu         = 0;
+    c->buffer       = (int_8 *)0;
+    c->fids         = tree_create ();
+    c->requests     = tree_create ();
+    c->parked       = (struct parked *)0;
+    c->next         = connections;
+
+    connections = c;
+
+    multiplex_add_d9s_io (io_open (up[0]), io_open (down[1]), fs);
+
+    in->type = iot_read;
+    c->server_reply->type = iot_read;
+
+    multiplex_add_io_no_callback (out);
+    multiplex_add_io_no_callback (c->server);
+    multiplex_add_io (c->server_reply, on_server_read, on_server_close,
+                      (void *)c);
+    multiplex_add_io (in, on_client_read, on_client_close, (void *)c);
+}
+
+void dev9_transport_release (int_16 majour, int_16 minor, char success)
+{
+    struct connection *c;
+
+    for (c = connections; c != (struct connection *)0; c = c->next)
+    {
+        struct parked **p = &(c->parked);
+
+        while ((*p) != (struct parked *)0)
+        {
+            struct parked *q = *p;
+
+            if ((q->majour != majour) || (q->minor != minor))
+            {
+                p = &(q->next);
+                continue;
+            }
+
+            *p = q->next;
+
+            if (success && (c->server != (struct io *)0))
+            {
+                /* the request stays, duat's reply settles it */
+                io_write (c->server, (char *)q->message, q->size);
+                io_flush (c->server);
+            }
+            else
+            {
+                forget_request (c, q->tag);
+                reply_error (c, q->tag, "no such device", P9_ENODEV);
+            }
+
+            free_parked (q);
+        }
+    }
+}
+
+void dev9_transport_add_stdio (struct dfs *fs)
+{
+    dev9_transport_add_io (io_open (0), io_open (1), fs);
+}
+
+static void on_connect (struct io *in, struct io *out, void *fs)
+{
+    dev9_transport_add_io (in, out, (struct dfs *)fs);
+}
+
+void dev9_transport_add_socket (const char *path, struct dfs *fs)
+{
+    multiplex_add_socket (path, on_connect, (void *)fs);
+}
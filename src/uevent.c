@@ -0,0 +1,94 @@
+/*
+ * This file is part of the kyuba.org Dev9 project.
+ * See the appropriate repository at http://git.kyuba.org/ for exact file
+ * modification records.
+*/
+
+/*
+ * Copyright (c) 2008-2014, Kyuba Project Members
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+
+#include <dev9/uevent.h>
+
+int_pointer dev9_uevent_parse
+        (char *b, int_pointer length, void (*on_event)(sexpr, void *),
+         void *aux)
+{
+    char *fragment_header = b,
+         *is = b,
+         *ms = b,
+         *i = b,
+         *max = (b + length),
+         frag_boundary = 0;
+    sexpr attributes = sx_end_of_list;
+
+    while (i < max)
+    {
+        frag_boundary = 0;
+
+        switch (*i)
+        {
+            case 0:
+                if (i == (max - 1)) /* definitely a fragment end */
+                {
+                    frag_boundary = 1;
+                }
+
+                if (is == ms) /* fragment header */
+                {
+                    if (is != b) /* first fragment header: nothing to examine */
+                    {
+                        attributes = cons(make_symbol (fragment_header), attributes);
+                        on_event (attributes, aux);
+                    }
+                    fragment_header = is;
+                    attributes = sx_end_of_list;
+                }
+                else /* key/value pair */
+                {
+                    *ms = 0;
+                    attributes = cons (cons(make_symbol(is),
+                                            make_string(ms+1)),
+                                       attributes);
+                    *ms = '=';
+                }
+
+                i++;
+                is = ms = i;
+                break;
+            case '=':
+                if (ms == is) ms = i;
+        }
+
+        i++;
+    }
+
+    if (frag_boundary)
+    {
+        attributes = cons(make_symbol (fragment_header), attributes);
+        on_event (attributes, aux);
+
+        return length;
+    }
+
+    return (int_pointer)(fragment_header - b);
+}
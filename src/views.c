@@ -0,0 +1,314 @@
+/*
+ * This file is part of the kyuba.org Dev9 project.
+ * See the appropriate repository at http://git.kyuba.org/ for exact file
+ * modification records.
+*/
+
+/*
+ * Copyright (c) 2008-2014, Kyuba Project Members
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+
+#include <dev9/views.h>
+#include <dev9/devices.h>
+#include <dev9/rules.h>
+#include <curie/memory.h>
+#include <curie/regex.h>
+#include <sievert/immutable.h>
+
+static struct dev9_view *views = (struct dev9_view *)0;
+
+enum view_change
+{
+    vc_update,
+    vc_add,
+    vc_remove
+};
+
+define_symbol (sym_socket,    "socket");
+define_symbol (sym_mount,     "mount");
+define_symbol (sym_subsystem, "subsystem");
+define_symbol (sym_select,    "select");
+define_symbol (sym_rename,    "rename");
+
+static int_32 prefix_length (const char *prefix, const char *s)
+{
+    int_32 i = 0;
+
+    while ((prefix[i] != (char)0) && (prefix[i] == s[i])) i++;
+
+    return (prefix[i] == (char)0) ? i : -1;
+}
+
+struct dev9_view *dev9_views (void)
+{
+    return views;
+}
+
+void dev9_view_add (sexpr sx)
+{
+    static struct memory_pool pool
+            = MEMORY_POOL_INITIALISER (sizeof (struct dev9_view));
+    sexpr name = car (sx);
+    struct dev9_view *v, **tail = &views;
+
+    if (!stringp(name))
+    {
+        return;
+    }
+
+    for (v = views; v != (struct dev9_view *)0; v = v->next)
+    {
+        if (dev9_streq (v->name, sx_string (name))) return;
+        tail = &(v->next);
+    }
+
+    v = (struct dev9_view *)get_pool_mem (&pool);
+
+    v->name             = str_immutable (sx_string (name));
+    v->socket           = (const char *)0;
+    v->mountpoint       = (const char *)0;
+    v->fs               = (struct dfs *)0;
+    v->subsystems_count = 0;
+    v->selections_count = 0;
+    v->renames_count    = 0;
+    v->next             = (struct dev9_view *)0;
+
+    for (sx = cdr (sx); consp(sx); sx = cdr (sx))
+    {
+        sexpr clause = car (sx);
+        sexpr op, a, b;
+
+        if (!consp(clause)) continue;
+
+        op = car (clause);
+        a  = car (cdr (clause));
+        b  = car (cdr (cdr (clause)));
+
+        if (!stringp(a)) continue;
+
+        if (truep(equalp(op, sym_socket)))
+        {
+            v->socket = str_immutable (sx_string (a));
+        }
+        else if (truep(equalp(op, sym_mount)))
+        {
+            v->mountpoint = str_immutable (sx_string (a));
+        }
+        else if (truep(equalp(op, sym_subsystem)) &&
+                 (v->subsystems_count < DEV9_VIEW_PATTERNS))
+        {
+            v->subsystems[v->subsystems_count] = rx_compile_sx (a);
+            v->subsystems_count++;
+        }
+        else if (truep(equalp(op, sym_select)) &&
+                 (v->selections_count < DEV9_VIEW_PATTERNS))
+        {
+            v->selections[v->selections_count] = rx_compile_sx (a);
+            v->selections_count++;
+        }
+        else if (truep(equalp(op, sym_rename)) && stringp(b) &&
+                 (v->renames_count < DEV9_VIEW_PATTERNS))
+        {
+            v->rename_from[v->renames_count] = str_immutable (sx_string (a));
+            v->rename_to[v->renames_count]   = str_immutable (sx_string (b));
+            v->renames_count++;
+        }
+    }
+
+    *tail = v;
+}
+
+void dev9_views_initialise (void)
+{
+    struct dev9_view *v;
+
+    for (v = views; v != (struct dev9_view *)0; v = v->next)
+    {
+        if (v->fs == (struct dfs *)0)
+        {
+            v->fs = dfs_create ((void *)0, (void *)0);
+            v->fs->root->c.mode |= 0111;
+        }
+    }
+}
+
+/* the subsystem is the device's as a string, or sx_nonexistent */
+static char view_selects
+        (struct dev9_view *v, sexpr subsystem, sexpr path)
+{
+    unsigned int i;
+
+    if (v->subsystems_count > 0)
+    {
+        if (!stringp(subsystem)) return 0;
+
+        for (i = 0; i < v->subsystems_count; i++)
+        {
+            if (truep(rx_match_sx (v->subsystems[i], subsystem)))
+            {
+                break;
+            }
+        }
+
+        if (i == v->subsystems_count) return 0;
+    }
+
+    if (v->selections_count > 0)
+    {
+        for (i = 0; i < v->selections_count; i++)
+        {
+            if (truep(rx_match_sx (v->selections[i], path))) return 1;
+        }
+
+        return 0;
+    }
+
+    return 1;
+}
+
+/* the name a path has in the view, after the first rename that applies */
+static char view_name
+        (struct dev9_view *v, const char *path, char *buf)
+{
+    unsigned int i;
+    int_32 l, pos = 0;
+    const char *rest = path;
+
+    for (i = 0; i < v->renames_count; i++)
+    {
+        if ((l = prefix_length (v->rename_from[i], path)) >= 0)
+        {
+            const char *to = v->rename_to[i];
+
+            for (; (*to != (char)0) && (pos < (DEV9_PATH_MAX - 1)); to++)
+            {
+                buf[pos] = *to;
+                pos++;
+            }
+
+            rest = path + l;
+            break;
+        }
+    }
+
+    for (; (*rest != (char)0) && (pos < (DEV9_PATH_MAX - 1)); rest++)
+    {
+        buf[pos] = *rest;
+        pos++;
+    }
+
+    buf[pos] = (char)0;
+
+    return (*rest == (char)0) && (pos > 0);
+}
+
+static char device_has_name (struct dev9_device *d, const char *path)
+{
+    int_32 i = 0;
+    const char *name;
+
+    while ((name = dev9_device_next_name (d, &i)) != (const char *)0)
+    {
+        if (dev9_streq (name, path)) return 1;
+    }
+
+    return 0;
+}
+
+static void update_view
+        (struct dev9_view *v, struct dev9_device *d, sexpr subsystem,
+         sexpr paths, enum view_change change)
+{
+    char buf[DEV9_PATH_MAX];
+
+    for (; consp(paths); paths = cdr (paths))
+    {
+        sexpr path = car (paths);
+        const char *p;
+
+        if (!stringp(path)) continue;
+
+        p = sx_string (path);
+
+        if (!view_selects (v, subsystem, path) || !view_name (v, p, buf))
+        {
+            continue;
+        }
+
+        if ((change == vc_remove) ||
+            ((change == vc_update) && !device_has_name (d, p)))
+        {
+            (void)dev9_device_unlink (v->fs, buf, d->majour, d->minor);
+        }
+        else
+        {
+            struct dfs_device *node = dev9_device_mknod_update
+                    (v->fs, buf, d->block_device, d->majour, d->minor);
+
+            if (node != (struct dfs_device *)0)
+            {
+                node->c.uid  = (char *)d->user;
+                node->c.muid = (char *)d->user;
+                node->c.gid  = (char *)d->group;
+                node->c.mode = (node->c.mode & ~07777) | d->mode;
+            }
+        }
+    }
+}
+
+static void change_views
+        (struct dev9_device *d, sexpr paths, enum view_change change)
+{
+    struct dev9_view *v;
+    sexpr subsystem;
+
+    if (views == (struct dev9_view *)0)
+    {
+        return;
+    }
+
+    subsystem = (d->subsystem != (const char *)0)
+              ? make_string (d->subsystem) : sx_nonexistent;
+
+    for (v = views; v != (struct dev9_view *)0; v = v->next)
+    {
+        if (v->fs != (struct dfs *)0)
+        {
+            update_view (v, d, subsystem, paths, change);
+        }
+    }
+}
+
+void dev9_views_update (struct dev9_device *d, sexpr paths)
+{
+    change_views (d, paths, vc_update);
+}
+
+void dev9_views_add (struct dev9_device *d, sexpr paths)
+{
+    change_views (d, paths, vc_add);
+}
+
+void dev9_views_remove (struct dev9_device *d, sexpr paths)
+{
+    change_views (d, paths, vc_remove);
+}